@@ -0,0 +1,632 @@
+// blockcache.cc
+//	Routines for the basic-block execution engine: translating user
+//	code into blocks of micro-ops, keeping the translations, and
+//	running them.
+//
+//	Running a block is exactly equivalent to running each of its
+//	instructions with Machine::OneInstruction: every micro-op
+//	applies the delayed load and advances the program counters and
+//	simulated time, so that the registers are always up to date
+//	when an interrupt or exception hands control to the kernel.
+//	What we save is the per-instruction fetch, translation and
+//	decode, and the trip through the dispatcher between blocks.
+//
+//	We leave translated code, and look up the next block from
+//	scratch, whenever the kernel might have changed something under
+//	us: after an exception, or after an interrupt handler has run.
+
+#include "copyright.h"
+#include "blockcache.h"
+#include "jit.h"
+#include "mipssim.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// BlockCache::BlockCache
+// 	Initialize an empty cache of translated blocks.
+//
+//	"memory" -- the simulated physical memory the code is read from
+//	"numFrames" -- the number of physical pages in "memory"
+//----------------------------------------------------------------------
+
+BlockCache::BlockCache(char *memory, int numFrames)
+{
+    int i;
+
+    mainMemory = memory;
+    numPhysPages = numFrames;
+    blocks = new TranslatedBlock[NumBlocks];
+    for (i = 0; i < NumBlocks; i++)
+	blocks[i].valid = FALSE;
+    frameBlocks = new TranslatedBlock *[numPhysPages];
+    codeWords = (bool *) AllocZeroedMemory(numPhysPages * InstrsPerPage
+					   * sizeof(bool), FALSE);
+    numTranslated = numFlushes = 0;
+    Flush();
+}
+
+//----------------------------------------------------------------------
+// BlockCache::~BlockCache
+// 	De-allocate the translations.
+//----------------------------------------------------------------------
+
+BlockCache::~BlockCache()
+{
+    DEBUG('e', "Block cache: %d blocks translated, %d flushes\n",
+	  numTranslated, numFlushes);
+    delete [] blocks;
+    delete [] frameBlocks;
+    FreeZeroedMemory((char *) codeWords, 
+		     numPhysPages * InstrsPerPage * sizeof(bool));
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Flush
+// 	Throw away every translation, eg, because we've run out of room.
+//----------------------------------------------------------------------
+
+void
+BlockCache::Flush()
+{
+    int i;
+
+    freeList = NULL;
+    for (i = NumBlocks - 1; i >= 0; i--) {
+	if (blocks[i].valid)
+	    memset(&codeWords[blocks[i].frame * InstrsPerPage], 0,
+		   InstrsPerPage * sizeof(bool));
+	blocks[i].valid = FALSE;
+	blocks[i].hashNext = freeList;
+	freeList = &blocks[i];
+    }
+    for (i = 0; i < BlockHashSize; i++)
+	hashTable[i] = NULL;
+    for (i = 0; i < numPhysPages; i++)
+	frameBlocks[i] = NULL;
+    numFlushes++;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::InvalidateFrame
+// 	The contents of physical page "frame" have changed (the program
+//	stored into its own code, or the kernel loaded something else
+//	into the frame), so throw away every block translated from it.
+//
+//	The block being run may be one of them; the engine notices
+//	because the block is no longer valid.
+//----------------------------------------------------------------------
+
+void
+BlockCache::InvalidateFrame(int frame)
+{
+    TranslatedBlock *block, **ptr;
+
+    DEBUG('e', "Invalidating translations of frame %d\n", frame);
+    while ((block = frameBlocks[frame]) != NULL) {
+	frameBlocks[frame] = block->frameNext;
+	for (ptr = &hashTable[((unsigned) block->virtAddr >> 2) % BlockHashSize];
+		*ptr != block; ptr = &(*ptr)->hashNext)
+	    ;
+	*ptr = block->hashNext;
+	block->valid = FALSE;
+	block->hashNext = freeList;
+	freeList = block;
+    }
+    memset(&codeWords[frame * InstrsPerPage], 0, InstrsPerPage * sizeof(bool));
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Find
+// 	Return the translation of the block starting at "virtAddr",
+//	whose code is in physical page "frame".  If it hasn't been
+//	translated yet, do it now.
+//----------------------------------------------------------------------
+
+TranslatedBlock *
+BlockCache::Find(int virtAddr, int frame)
+{
+    TranslatedBlock *block;
+
+    for (block = hashTable[((unsigned) virtAddr >> 2) % BlockHashSize];
+		block != NULL; block = block->hashNext)
+	if (block->virtAddr == virtAddr && block->frame == frame)
+	    return block;
+    return Translate(virtAddr, frame);
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Chained
+// 	If block "from" has been chained to the block at "virtAddr"
+//	(in "frame"), and that translation is still good, return it.
+//----------------------------------------------------------------------
+
+TranslatedBlock *
+BlockCache::Chained(TranslatedBlock *from, int virtAddr, int frame)
+{
+    TranslatedBlock *to;
+
+    for (int i = 0; i < 2; i++) {
+	to = from->chain[i];
+	if (to != NULL && to->valid && to->virtAddr == virtAddr
+		&& to->frame == frame)
+	    return to;
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Chain
+// 	Remember that block "from" exited to block "to".  A block has
+//	at most two places to go (a branch is taken or not), so we keep
+//	the two most recent ones.
+//----------------------------------------------------------------------
+
+void
+BlockCache::Chain(TranslatedBlock *from, TranslatedBlock *to)
+{
+    from->chain[1] = from->chain[0];
+    from->chain[0] = to;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::Translate
+// 	Translate the block starting at "virtAddr", whose code is in
+//	physical page "frame", and enter it in the cache.
+//
+//	The block ends after the first branch or jump and its delay
+//	slot, after a system call, or at the end of the page.  We
+//	don't put a branch into a delay slot (MIPS doesn't allow it
+//	anyway); the block ends before it instead.
+//----------------------------------------------------------------------
+
+TranslatedBlock *
+BlockCache::Translate(int virtAddr, int frame)
+{
+    TranslatedBlock *block;
+    Instruction instr;
+    unsigned int offset = (unsigned) virtAddr % PageSize;
+    unsigned int *word = (unsigned int *) &mainMemory[frame * PageSize + offset];
+    int first = frame * InstrsPerPage + offset / 4;
+    int pc = virtAddr;
+    bool delaySlot = FALSE;
+
+    if (freeList == NULL) {
+	DEBUG('e', "Block cache full, flushing\n");
+	Flush();
+    }
+    block = freeList;
+    freeList = block->hashNext;
+
+    block->virtAddr = virtAddr;
+    block->frame = frame;
+    block->numOps = 0;
+    while (offset < PageSize) {
+	instr.value = WordToHost(*word);
+	instr.Decode();
+	if (delaySlot && (IsControlTransfer(instr.opCode)
+			  || instr.opCode == OP_SYSCALL))
+	    break;
+	TranslateInstruction(&instr, pc, &block->ops[block->numOps++]);
+	if (delaySlot || instr.opCode == OP_SYSCALL)
+	    break;
+	delaySlot = IsControlTransfer(instr.opCode);
+	offset += 4;
+	pc += 4;
+	word++;
+    }
+    block->noStores = TRUE;
+    for (int i = 0; i < block->numOps; i++) {
+	codeWords[first + i] = TRUE;
+	if (block->ops[i].code == UOP_SW || block->ops[i].code == UOP_SB
+		|| block->ops[i].code == UOP_GENERIC)
+	    block->noStores = FALSE;
+    }
+
+    block->valid = TRUE;
+    block->runs = 0;
+    block->native = NULL;
+    block->chain[0] = block->chain[1] = NULL;
+    block->frameNext = frameBlocks[frame];
+    frameBlocks[frame] = block;
+    block->hashNext = hashTable[((unsigned) virtAddr >> 2) % BlockHashSize];
+    hashTable[((unsigned) virtAddr >> 2) % BlockHashSize] = block;
+    numTranslated++;
+    DEBUG('e', "Translated block at 0x%x (frame %d), %d instructions\n",
+	  virtAddr, frame, block->numOps);
+    return block;
+}
+
+//----------------------------------------------------------------------
+// BlockCache::TranslateInstruction
+// 	Turn one decoded instruction, at virtual address "pc", into a
+//	micro-op.  The semantics must be exactly those of
+//	Machine::OneInstruction, quirks and all: OR only looks at "rs",
+//	and SRL/SRLV shift arithmetically.
+//
+//	Every instruction in a block except the first is known to
+//	follow its predecessor (NextPC == PC + 4), so branch targets and
+//	return addresses can be computed now.
+//----------------------------------------------------------------------
+
+void
+BlockCache::TranslateInstruction(Instruction *instr, int pc, MicroOp *op)
+{
+    int target = pc + 4 + IndexToAddr(instr->extra);
+
+    op->instr = *instr;
+    op->code = UOP_GENERIC;
+    op->rd = instr->rd;
+    op->rs = instr->rs;
+    op->rt = instr->rt;
+    op->imm = instr->extra;
+
+    switch (instr->opCode) {
+      case OP_ADDIU:
+	op->code = (instr->rs == 0) ? UOP_LI : UOP_ADDIU;
+	op->rd = instr->rt;
+	break;
+      case OP_ADDU:
+	if (instr->rt == 0) {
+	    op->code = UOP_MOVE;
+	} else if (instr->rs == 0) {
+	    op->code = UOP_MOVE;
+	    op->rs = instr->rt;
+	} else
+	    op->code = UOP_ADDU;
+	break;
+      case OP_OR:			// "rs | rs", see OneInstruction
+	op->code = UOP_MOVE;
+	break;
+      case OP_SUBU: op->code = UOP_SUBU; break;
+      case OP_AND: op->code = UOP_AND; break;
+      case OP_XOR: op->code = UOP_XOR; break;
+      case OP_NOR: op->code = UOP_NOR; break;
+      case OP_SLT: op->code = UOP_SLT; break;
+      case OP_SLTU: op->code = UOP_SLTU; break;
+      case OP_SLLV: op->code = UOP_SLLV; break;
+      case OP_SRAV:
+      case OP_SRLV: op->code = UOP_SRAV; break;
+      case OP_SLL: op->code = UOP_SLL; break;
+      case OP_SRA:
+      case OP_SRL: op->code = UOP_SRA; break;
+      case OP_MFHI: op->code = UOP_MFHI; break;
+      case OP_MFLO: op->code = UOP_MFLO; break;
+      case OP_ANDI:
+      case OP_ORI:
+      case OP_XORI:
+	op->imm = instr->extra & 0xffff;
+	op->rd = instr->rt;
+	if (instr->opCode == OP_ANDI)
+	    op->code = UOP_ANDI;
+	else if (instr->opCode == OP_XORI)
+	    op->code = UOP_XORI;
+	else
+	    op->code = (instr->rs == 0) ? UOP_LI : UOP_ORI;
+	break;
+      case OP_LUI:
+	op->code = UOP_LI;
+	op->rd = instr->rt;
+	op->imm = instr->extra << 16;
+	break;
+      case OP_SLTI: op->code = UOP_SLTI; op->rd = instr->rt; break;
+      case OP_SLTIU: op->code = UOP_SLTIU; op->rd = instr->rt; break;
+      case OP_LW: op->code = UOP_LW; break;
+      case OP_LB: op->code = UOP_LB; break;
+      case OP_LBU: op->code = UOP_LBU; break;
+      case OP_SW: op->code = UOP_SW; break;
+      case OP_SB: op->code = UOP_SB; break;
+      case OP_BEQ: op->code = UOP_BEQ; op->imm = target; break;
+      case OP_BNE: op->code = UOP_BNE; op->imm = target; break;
+      case OP_BLEZ: op->code = UOP_BLEZ; op->imm = target; break;
+      case OP_BGTZ: op->code = UOP_BGTZ; op->imm = target; break;
+      case OP_BLTZ: op->code = UOP_BLTZ; op->imm = target; break;
+      case OP_BGEZ: op->code = UOP_BGEZ; op->imm = target; break;
+      case OP_J:
+      case OP_JAL:
+	op->code = (instr->opCode == OP_J) ? UOP_J : UOP_JAL;
+	op->imm = ((pc + 8) & 0xf0000000) | IndexToAddr(instr->extra);
+	break;
+      case OP_JR: op->code = UOP_JR; break;
+      case OP_JALR: op->code = UOP_JALR; break;
+      default:
+	break;			// leave it to the reference simulator
+    }
+
+    // Register-to-register operations whose result goes to r0 have no
+    // effect at all; r0 is reset before anyone can see it.
+    if (op->code >= UOP_LI && op->code <= UOP_MFLO && op->rd == 0)
+	op->code = UOP_NOP;
+}
+
+//----------------------------------------------------------------------
+// IsControlTransfer
+// 	Is "opCode" a branch or jump, ie, followed by a delay slot?
+//----------------------------------------------------------------------
+
+bool
+IsControlTransfer(int opCode)
+{
+    switch (opCode) {
+      case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ:
+      case OP_BLTZ: case OP_BGEZ: case OP_BLTZAL: case OP_BGEZAL:
+      case OP_J: case OP_JAL: case OP_JR: case OP_JALR:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBlocks
+// 	Simulate the execution of a user-level program, using the
+//	block engine.  Called by Machine::Run; never returns.
+//
+//	We can only start a block where execution is sequential
+//	(NextPC == PC + 4).  The one case where it isn't -- resuming in
+//	a delay slot after an exception or at a page boundary -- is
+//	handled an instruction at a time by the reference simulator.
+//
+//	With the JIT engine, a block that has been compiled is started
+//	by running its compiled code, and we interpret whatever that
+//	leaves undone.
+//
+//	When a block without stores branches back to itself, we compare
+//	the registers with those it started the iteration with.  If they
+//	are the same, the loop is spinning (typically, polling a flag
+//	only an interrupt handler can change), and every further
+//	iteration will be identical until an interrupt falls due.  So
+//	we count those iterations as executed without running them,
+//	leaving the last complete one to be run for real, so that the
+//	use and dirty bits come out just as they would have.
+//----------------------------------------------------------------------
+
+void
+Machine::RunBlocks()
+{
+    Instruction scratch;
+    TranslatedBlock *block, *next, *spinning;
+    MicroOp *op, *last;
+    ExceptionType exception;
+    int physAddr, frame, pc;
+    int nextLoadReg, nextLoadValue, pcAfter, tmp, value, done, skip;
+    int spinRegisters[NumTotalRegs];	// registers at the start of the
+					// iteration of "spinning"
+
+    for (;;) {
+	spinning = NULL;		// the kernel may have run
+	pc = registers[PCReg];
+	if (registers[NextPCReg] != pc + 4) {
+	    OneInstruction(&scratch);
+	    Tick();
+	    continue;
+	}
+	exception = Translate(pc, &physAddr, 4, FALSE);
+	if (exception != NoException) {
+	    RaiseException(exception, pc);
+	    Tick();
+	    continue;
+	}
+	frame = physAddr / PageSize;
+	block = blockCache->Find(pc, frame);
+
+      run:
+	op = block->ops;
+	if (jit != NULL) {
+	    if (block->native == NULL && ++block->runs == JitThreshold) {
+		jit->Compile(block);
+		if (!block->valid)
+		    continue;		// the JIT flushed the cache
+	    }
+	    // Compiled code doesn't check for interrupts, so only run it
+	    // if Tick could count the whole block without one falling due.
+	    if (block->native != NULL && batchLeft >= block->numOps) {
+		done = (*block->native)(registers);
+		batchLeft -= done;
+		batchDone += done;
+		op += done;		// interpret whatever is left
+	    }
+	}
+	for (last = block->ops + block->numOps; op < last; op++) {
+	    nextLoadReg = 0;
+	    nextLoadValue = 0;
+	    pcAfter = registers[NextPCReg] + 4;
+
+	    switch (op->code) {
+	      case UOP_GENERIC:
+		if (!ExecuteInstruction(&op->instr))
+		    goto trapped;
+		goto retired;
+	      case UOP_NOP:
+		break;
+	      case UOP_LI:
+		registers[(int)op->rd] = op->imm;
+		break;
+	      case UOP_MOVE:
+		registers[(int)op->rd] = registers[(int)op->rs];
+		break;
+	      case UOP_ADDIU:
+		registers[(int)op->rd] = registers[(int)op->rs] + op->imm;
+		break;
+	      case UOP_ADDU:
+		registers[(int)op->rd] = registers[(int)op->rs] + registers[(int)op->rt];
+		break;
+	      case UOP_SUBU:
+		registers[(int)op->rd] = registers[(int)op->rs] - registers[(int)op->rt];
+		break;
+	      case UOP_AND:
+		registers[(int)op->rd] = registers[(int)op->rs] & registers[(int)op->rt];
+		break;
+	      case UOP_XOR:
+		registers[(int)op->rd] = registers[(int)op->rs] ^ registers[(int)op->rt];
+		break;
+	      case UOP_NOR:
+		registers[(int)op->rd] = ~(registers[(int)op->rs] | registers[(int)op->rt]);
+		break;
+	      case UOP_ANDI:
+		registers[(int)op->rd] = registers[(int)op->rs] & op->imm;
+		break;
+	      case UOP_ORI:
+		registers[(int)op->rd] = registers[(int)op->rs] | op->imm;
+		break;
+	      case UOP_XORI:
+		registers[(int)op->rd] = registers[(int)op->rs] ^ op->imm;
+		break;
+	      case UOP_SLT:
+		registers[(int)op->rd] =
+		    registers[(int)op->rs] < registers[(int)op->rt];
+		break;
+	      case UOP_SLTU:
+		registers[(int)op->rd] = (unsigned) registers[(int)op->rs]
+		    < (unsigned) registers[(int)op->rt];
+		break;
+	      case UOP_SLTI:
+		registers[(int)op->rd] = registers[(int)op->rs] < op->imm;
+		break;
+	      case UOP_SLTIU:
+		registers[(int)op->rd] = (unsigned) registers[(int)op->rs]
+		    < (unsigned) op->imm;
+		break;
+	      case UOP_SLL:
+		registers[(int)op->rd] = registers[(int)op->rt] << op->imm;
+		break;
+	      case UOP_SRA:
+		registers[(int)op->rd] = registers[(int)op->rt] >> op->imm;
+		break;
+	      case UOP_SLLV:
+		registers[(int)op->rd] = registers[(int)op->rt] <<
+		    (registers[(int)op->rs] & 0x1f);
+		break;
+	      case UOP_SRAV:
+		registers[(int)op->rd] = registers[(int)op->rt] >>
+		    (registers[(int)op->rs] & 0x1f);
+		break;
+	      case UOP_MFHI:
+		registers[(int)op->rd] = registers[HiReg];
+		break;
+	      case UOP_MFLO:
+		registers[(int)op->rd] = registers[LoReg];
+		break;
+	      case UOP_LW:
+		tmp = registers[(int)op->rs] + op->imm;
+		if (tmp & 0x3) {
+		    RaiseException(AddressErrorException, tmp);
+		    goto trapped;
+		}
+		if (!ReadMem(tmp, 4, &value))
+		    goto trapped;
+		nextLoadReg = op->rt;
+		nextLoadValue = value;
+		break;
+	      case UOP_LB:
+	      case UOP_LBU:
+		if (!ReadMem(registers[(int)op->rs] + op->imm, 1, &value))
+		    goto trapped;
+		if ((value & 0x80) && (op->code == UOP_LB))
+		    value |= 0xffffff00;
+		else
+		    value &= 0xff;
+		nextLoadReg = op->rt;
+		nextLoadValue = value;
+		break;
+	      case UOP_SW:
+		if (!WriteMem((unsigned) (registers[(int)op->rs] + op->imm), 4,
+			      registers[(int)op->rt]))
+		    goto trapped;
+		break;
+	      case UOP_SB:
+		if (!WriteMem((unsigned) (registers[(int)op->rs] + op->imm), 1,
+			      registers[(int)op->rt]))
+		    goto trapped;
+		break;
+	      case UOP_BEQ:
+		if (registers[(int)op->rs] == registers[(int)op->rt])
+		    pcAfter = op->imm;
+		break;
+	      case UOP_BNE:
+		if (registers[(int)op->rs] != registers[(int)op->rt])
+		    pcAfter = op->imm;
+		break;
+	      case UOP_BLEZ:
+		if (registers[(int)op->rs] <= 0)
+		    pcAfter = op->imm;
+		break;
+	      case UOP_BGTZ:
+		if (registers[(int)op->rs] > 0)
+		    pcAfter = op->imm;
+		break;
+	      case UOP_BLTZ:
+		if (registers[(int)op->rs] & SIGN_BIT)
+		    pcAfter = op->imm;
+		break;
+	      case UOP_BGEZ:
+		if (!(registers[(int)op->rs] & SIGN_BIT))
+		    pcAfter = op->imm;
+		break;
+	      case UOP_JAL:
+		registers[R31] = registers[NextPCReg] + 4;
+	      case UOP_J:
+		pcAfter = op->imm;
+		break;
+	      case UOP_JALR:
+		registers[(int)op->rd] = registers[NextPCReg] + 4;
+	      case UOP_JR:
+		pcAfter = registers[(int)op->rs];
+		break;
+	    }
+
+	    // retire the instruction, as in OneInstruction
+	    registers[registers[LoadReg]] = registers[LoadValueReg];
+	    registers[LoadReg] = nextLoadReg;
+	    registers[LoadValueReg] = nextLoadValue;
+	    registers[0] = 0;
+	    registers[PrevPCReg] = registers[PCReg];
+	    registers[PCReg] = registers[NextPCReg];
+	    registers[NextPCReg] = pcAfter;
+
+	  retired:
+	    if (Tick() || !block->valid)
+		goto restart;	// the kernel ran, or we overwrote the block
+	}
+
+	// Go on to the next block, without going back through the
+	// dispatcher if we have been there before.
+	pc = registers[PCReg];
+	if (registers[NextPCReg] != pc + 4)
+	    continue;
+	if ((unsigned) pc / PageSize != (unsigned) block->virtAddr / PageSize) {
+	    exception = Translate(pc, &physAddr, 4, FALSE);
+	    if (exception != NoException) {
+		RaiseException(exception, pc);
+		Tick();
+		continue;
+	    }
+	    frame = physAddr / PageSize;
+	}
+	next = blockCache->Chained(block, pc, frame);
+	if (next == NULL) {
+	    next = blockCache->Find(pc, frame);
+	    blockCache->Chain(block, next);
+	}
+	if (next == block && block->noStores) {
+	    if (spinning == block
+		    && memcmp(spinRegisters, registers, sizeof(registers)) == 0) {
+		skip = (batchLeft / block->numOps - 1) * block->numOps;
+		if (skip > 0) {
+		    batchLeft -= skip;
+		    batchDone += skip;
+		    spinSkipped += skip;
+		}
+	    } else {
+		spinning = block;
+		memcpy(spinRegisters, registers, sizeof(registers));
+	    }
+	}
+	block = next;
+	goto run;
+
+      trapped:
+	Tick();
+      restart:
+	;
+    }
+}
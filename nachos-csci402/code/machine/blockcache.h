@@ -0,0 +1,138 @@
+// blockcache.h
+//	Data structures for the basic-block execution engine.
+//
+//	The block engine translates each straight-line run of user code
+//	(a "basic block"), the first time it is executed, into a compact
+//	sequence of micro-ops, and keeps the translation around so that
+//	the next time the block runs, nothing has to be fetched,
+//	translated or decoded again.  A block ends with a branch or
+//	jump, together with its delay slot, or at the end of a page.
+//
+//	Translations are keyed by the virtual address of the first
+//	instruction together with the physical page that holds the code.
+//	The physical page stands in for the address space: two address
+//	spaces can only share a translation if they map the same code
+//	at the same address.  Since a block never crosses a page
+//	boundary, all of its code is in that one page.
+//
+//	Each block remembers the blocks it has exited to, so that a block
+//	that follows another can be started without looking it up.
+//
+//	A block that loops back to itself without storing to memory, and
+//	leaves every register as it found it, is spinning: it will do
+//	exactly the same thing every time around until an interrupt
+//	comes along.  The engine skips such iterations, advancing the
+//	clock instead of simulating them (see Machine::RunBlocks).
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "machine.h"
+
+#define MaxBlockOps	InstrsPerPage	// a block never crosses a page
+#define NumBlocks	1024		// translated blocks kept at once
+#define BlockHashSize	512		// buckets for looking up blocks
+
+// The micro-operations a block is translated into.  Most are a MIPS
+// instruction with its operands simplified: constants are computed
+// ahead of time, writes to r0 become no-ops, branch targets are
+// absolute.  Anything rare or tricky is left to the reference
+// simulator, as a "generic" micro-op.
+
+enum MicroOpCode { UOP_GENERIC,	// run the original instruction
+		   UOP_NOP,	// no visible effect
+		   UOP_LI,	// rd = imm
+		   UOP_MOVE,	// rd = rs
+		   UOP_ADDIU, UOP_ADDU, UOP_SUBU,
+		   UOP_AND, UOP_XOR, UOP_NOR,
+		   UOP_ANDI, UOP_ORI, UOP_XORI,	// imm already masked
+		   UOP_SLT, UOP_SLTU, UOP_SLTI, UOP_SLTIU,
+		   UOP_SLL, UOP_SRA, UOP_SLLV, UOP_SRAV,
+		   UOP_MFHI, UOP_MFLO,
+		   UOP_LW, UOP_LB, UOP_LBU, UOP_SW, UOP_SB,
+		   UOP_BEQ, UOP_BNE, UOP_BLEZ, UOP_BGTZ,	// imm is the
+		   UOP_BLTZ, UOP_BGEZ, UOP_J, UOP_JAL,	// target address
+		   UOP_JR, UOP_JALR
+};
+
+// One translated instruction.
+
+class MicroOp {
+  public:
+    char code;			// a MicroOpCode
+    char rd, rs, rt;		// the registers it uses
+    int imm;			// its (precomputed) constant operand
+    Instruction instr;		// the original instruction, for
+				// UOP_GENERIC
+};
+
+// Host machine code compiled from a block (see jit.h).  It runs
+// the first instructions of the block, and returns how many it ran.
+
+typedef int (*NativeCode)(int *registers);
+
+// A translated basic block.
+
+class TranslatedBlock {
+  public:
+    int virtAddr;		// virtual address of the first instruction
+    int frame;			// physical page the code was read from
+    bool valid;			// FALSE once the code has been overwritten
+    int numOps;			// number of instructions in the block
+    MicroOp ops[MaxBlockOps];	// the translation
+    int runs;			// how often it has been run, until compiled
+    bool noStores;		// does the block leave memory alone?  (it
+				// has no stores, and no generic micro-ops)
+    NativeCode native;		// compiled code, or NULL
+
+    TranslatedBlock *chain[2];	// blocks this one has exited to
+    TranslatedBlock *hashNext;	// next block in the same hash bucket
+    TranslatedBlock *frameNext;	// next block translated from "frame"
+};
+
+bool IsControlTransfer(int opCode);	// is "opCode" a branch or jump?
+
+// The cache of translated blocks.
+
+class BlockCache {
+  public:
+    BlockCache(char *memory, int numFrames);
+				// "memory" is the simulated physical memory
+    ~BlockCache();
+
+    TranslatedBlock *Find(int virtAddr, int frame);
+				// Return the translation of the block at
+				// "virtAddr", whose code is in "frame",
+				// translating it if we don't have one
+    TranslatedBlock *Chained(TranslatedBlock *from, int virtAddr, int frame);
+				// The block at "virtAddr" if "from" has
+				// already been chained to it, else NULL
+    void Chain(TranslatedBlock *from, TranslatedBlock *to);
+				// Remember that "from" exits to "to"
+
+    bool IsCode(int physAddr) { return codeWords[(unsigned) physAddr / 4]; }
+				// Is the word at "physAddr" part of a
+				// translated block?
+    void InvalidateFrame(int frame);
+				// Throw away every block translated from
+				// "frame", because its contents changed
+    void Flush();		// Throw away every block
+
+  private:
+    TranslatedBlock *Translate(int virtAddr, int frame);
+    void TranslateInstruction(Instruction *instr, int pc, MicroOp *op);
+
+    char *mainMemory;		// where the code is read from
+    int numPhysPages;		// number of frames in "mainMemory"
+    TranslatedBlock *blocks;	// storage for all the translations
+    TranslatedBlock *freeList;	// unused entries in "blocks"
+    TranslatedBlock *hashTable[BlockHashSize];
+    TranslatedBlock **frameBlocks; // blocks translated from each frame
+    bool *codeWords;		// which words of memory are translated
+    int numTranslated;		// statistics, for debugging
+    int numFlushes;
+};
+
+#endif // BLOCKCACHE_H
@@ -30,7 +30,8 @@ using namespace std;
 #include <iostream>
 static char *intLevelNames[] = { "off", "on"};
 static char *intTypeNames[] = { "timer", "disk", "console write", 
-			"console read", "network send", "network recv"};
+			"console read", "network send", "network recv",
+			"page aging"};
 using namespace std;
 //----------------------------------------------------------------------
 // PendingInterrupt::PendingInterrupt
@@ -148,11 +149,16 @@ Interrupt::Enable()
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	Returns TRUE if the kernel got control -- some interrupt handler
+//	ran, and possibly a context switch happened -- so that the
+//	machine simulation knows the kernel may have changed its state.
 //----------------------------------------------------------------------
-void
+bool
 Interrupt::OneTick()
 {
     MachineStatus old = status;
+    bool fired = FALSE;
 
 // advance simulated time
     if (status == SystemMode) 
@@ -176,7 +182,7 @@ Interrupt::OneTick()
 					// interrupts disabled)
     
     while (CheckIfDue(FALSE))		// check for pending interrupts
-	;
+	fired = TRUE;
     
     ChangeLevel(IntOff, IntOn);		// re-enable interrupts
     if (yieldOnReturn) {		// if the timer device handler asked 
@@ -186,6 +192,49 @@ Interrupt::OneTick()
 	currentThread->Yield();
 	status = old;
     }
+    return fired;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::NextDue
+// 	Return the time at which the earliest pending interrupt is due,
+//	or a time far in the future if nothing is pending.
+//
+//	The fast execution engines use this to find out how many user
+//	instructions they can run before OneTick would do anything but
+//	advance the clock.
+//----------------------------------------------------------------------
+
+int64_t
+Interrupt::NextDue()
+{
+    int64_t when;
+
+    if (pending->SortedPeek(&when) == NULL)
+	return 0x7fffffffffffffffLL;	// never
+    return when;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::AdvanceTicks
+// 	Account for "count" calls to OneTick at once.  The caller must
+//	have checked (with NextDue) that no interrupt falls due before
+//	simulated time has been advanced, since none will be invoked.
+//
+//	"count" -- the number of ticks (instructions, in user mode)
+//----------------------------------------------------------------------
+
+void
+Interrupt::AdvanceTicks(int count)
+{
+    if (status == SystemMode) {
+        stats->totalTicks += count * SystemTick;
+	stats->systemTicks += count * SystemTick;
+    } else {
+	stats->totalTicks += count * UserTick;
+	stats->userTicks += count * UserTick;
+    }
+    ASSERT(stats->totalTicks < NextDue());
 }
 
 //----------------------------------------------------------------------
@@ -252,6 +301,9 @@ Interrupt::Halt()
 {
     printf("Machine halting!\n\n");
     stats->Print();
+#ifdef VM
+    loadControl->Print();		// and each process's
+#endif
     Cleanup();     // Never returns.
 }
 
@@ -286,6 +338,32 @@ Interrupt::Schedule(VoidFunctionPtr handler, int arg, int64_t fromNow, IntType t
     pending->SortedInsert(toOccur, when);
 }
 
+//----------------------------------------------------------------------
+// OnlyTimersPending
+// 	Return TRUE if every interrupt in "pending" is a timer interrupt
+//	or the page aging clock.  Those just go on forever, so an idle 
+//	machine with nothing else to wait for is done.
+//----------------------------------------------------------------------
+
+static bool onlyTimers;		// what NoteInterruptType has found
+
+static void
+NoteInterruptType(int arg)
+{
+    PendingInterrupt *pend = (PendingInterrupt *)arg;
+
+    if (pend->type != TimerInt && pend->type != AgingInt)
+	onlyTimers = FALSE;
+}
+
+static bool
+OnlyTimersPending(List *pending)
+{
+    onlyTimers = TRUE;
+    pending->Mapcar(NoteInterruptType);
+    return onlyTimers;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::CheckIfDue
 // 	Check if an interrupt is scheduled to occur, and if so, fire it off.
@@ -298,7 +376,9 @@ Interrupt::Schedule(VoidFunctionPtr handler, int arg, int64_t fromNow, IntType t
 //		so we should simply advance the clock to when the next 
 //		pending interrupt would occur (if any).  If the pending
 //		interrupt is just the time-slice daemon, however, then 
-//		we're done!
+//		we're done!  The page aging clock doesn't count: an idle
+//		machine stops (or advances to the time-slice daemon) just
+//		as if it weren't there.
 //----------------------------------------------------------------------
     
 bool
@@ -319,6 +399,16 @@ Interrupt::CheckIfDue(bool advanceClock)
     if (toOccur == NULL)		// no pending interrupts
 	return FALSE;			
 
+// The aging clock has nothing to do for an idle machine, so if all it
+// would be waiting for is clocks, look past it
+    if ((status == IdleMode) && (toOccur->type == AgingInt) 
+				&& OnlyTimersPending(pending)) {
+	bool fired = CheckIfDue(advanceClock);
+
+	pending->SortedInsert(toOccur, when);
+	return fired;
+    }
+
     if (advanceClock ) 
     {	// advance the clock
         if(when > stats->totalTicks)
@@ -334,7 +424,7 @@ Interrupt::CheckIfDue(bool advanceClock)
 
 // Check if there is nothing more to do, and if so, quit
     if ((status == IdleMode) && (toOccur->type == TimerInt) 
-				&& pending->IsEmpty()) {
+				&& OnlyTimersPending(pending)) {
 	 pending->SortedInsert(toOccur, when);
 	 return FALSE;
     }
@@ -48,9 +48,10 @@ enum MachineStatus {IdleMode, SystemMode, UserMode};
 
 // IntType records which hardware device generated an interrupt.
 // In Nachos, we support a hardware timer device, a disk, a console
-// display and keyboard, and a network.
+// display and keyboard, and a network; the kernel's page aging clock
+// gets a type of its own, so that an idle machine can ignore it.
 enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt, 
-				NetworkSendInt, NetworkRecvInt};
+				NetworkSendInt, NetworkRecvInt, AgingInt};
 
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
@@ -110,7 +111,11 @@ class Interrupt {
 	int arg, int64_t when, IntType type);// at time ``when''.  This is called
     					// by the hardware device simulators.
     
-    void OneTick();       		// Advance simulated time
+    bool OneTick();       		// Advance simulated time; return
+					// TRUE if any interrupt handler ran
+    int64_t NextDue();			// When the next interrupt is due
+    void AdvanceTicks(int count);	// Do "count" OneTicks at once, when
+					// no interrupt can fall due meanwhile
 
   private:
     IntStatus level;		// are interrupts enabled or disabled?
@@ -0,0 +1,497 @@
+// jit.cc
+//	Routines to compile translated blocks into x86-64 machine code.
+//
+//	The compiled code for a block is a function, called from
+//	Machine::RunBlocks with a pointer to Machine::registers, which
+//	it keeps in %rbx.  Each micro-op is compiled into the same
+//	steps as its case in RunBlocks: compute the result into
+//	registers[], then retire the instruction.  Retiring is cheap,
+//	since we know, when compiling, whether the previous instruction
+//	was a load, and where every instruction is: the program
+//	counters are only written to registers[] at a branch, and when
+//	the compiled code stops.
+//
+//	Memory is accessed by calling Machine::TryReadMem and
+//	Machine::TryWriteMem.  If one fails, the compiled code stops
+//	just before that instruction, and returns to the interpreter.
+
+#include "copyright.h"
+#include "jit.h"
+#include "system.h"
+
+#ifdef __x86_64__
+#include <sys/mman.h>
+#endif
+
+// Host registers used by the compiled code.  %rbx, which holds the
+// address of the simulated registers, is the only one that survives
+// the calls into the simulator.
+
+#define EAX	0
+#define ECX	1
+#define EDX	2		// holds the value of a load, until it is retired
+
+// What we know, when compiling, about the delayed load pending when
+// an instruction starts (otherwise, the register being loaded)
+
+#define NoLoad		-1	// none
+#define UnknownLoad	-2	// left by whatever ran before the block
+
+// Some x86 conditional jumps (with an 8-bit offset)
+
+#define JE	0x74
+#define JNE	0x75
+#define JNS	0x79
+#define JL	0x7c
+#define JGE	0x7d
+#define JLE	0x7e
+#define JG	0x7f
+
+//----------------------------------------------------------------------
+// LoadHelper, StoreHelper
+// 	Called from compiled code to access memory.  LoadHelper returns
+//	the (zero-extended) value read, or -1 if the access failed;
+//	StoreHelper returns whether the access succeeded.
+//----------------------------------------------------------------------
+
+static int64_t
+LoadHelper(int addr, int size)
+{
+    int value;
+
+    if (!machine->TryReadMem(addr, size, &value))
+	return -1;
+    return (unsigned int) value;
+}
+
+static int
+StoreHelper(int addr, int size, int value)
+{
+    return machine->TryWriteMem(addr, size, value);
+}
+
+//----------------------------------------------------------------------
+// IsBranch
+// 	Is micro-op "code" a branch or jump?
+//----------------------------------------------------------------------
+
+static bool
+IsBranch(int code)
+{
+    return (code >= UOP_BEQ) && (code <= UOP_JALR);
+}
+
+//----------------------------------------------------------------------
+// JitCompiler::JitCompiler
+// 	Set aside executable memory for compiled code.  If we can't,
+//	we just don't compile anything.
+//
+//	"cache" -- the translated blocks we will be compiling
+//----------------------------------------------------------------------
+
+JitCompiler::JitCompiler(BlockCache *cache)
+{
+    blockCache = cache;
+    codeCache = NULL;
+#ifdef __x86_64__
+    codeCache = (unsigned char *) mmap(NULL, JitCacheSize,
+				       PROT_READ | PROT_WRITE | PROT_EXEC,
+				       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (codeCache == (unsigned char *) MAP_FAILED) {
+	DEBUG('e', "Can't allocate the JIT code cache, not compiling\n");
+	codeCache = NULL;
+    }
+#endif
+    used = 0;
+    numCompiled = numFlushes = 0;
+}
+
+//----------------------------------------------------------------------
+// JitCompiler::~JitCompiler
+// 	Give back the memory for compiled code.
+//----------------------------------------------------------------------
+
+JitCompiler::~JitCompiler()
+{
+    DEBUG('e', "JIT: %d blocks compiled, %d flushes\n", numCompiled,
+	  numFlushes);
+#ifdef __x86_64__
+    if (codeCache != NULL)
+	munmap(codeCache, JitCacheSize);
+#endif
+}
+
+//----------------------------------------------------------------------
+// JitCompiler::Compile
+// 	Compile as much of "block" as we can, from the start up to the
+//	first micro-op we don't handle, and set block->native.  Leave
+//	it NULL if the very first micro-op can't be compiled.
+//
+//	Compiled code is never freed individually; when the code cache
+//	fills up, we throw away every translation and start over.
+//----------------------------------------------------------------------
+
+void
+JitCompiler::Compile(TranslatedBlock *block)
+{
+    unsigned char *start;
+    int i, pc, pending, loaded;
+
+    if (codeCache == NULL)
+	return;
+    if (used + (block->numOps + 1) * JitMaxOpSize > JitCacheSize) {
+	DEBUG('e', "JIT code cache full, flushing\n");
+	blockCache->Flush();
+	used = 0;
+	numFlushes++;
+	return;
+    }
+
+    start = code = codeCache + used;
+    Byte(0x53);				// push %rbx
+    Byte(0x48); Byte(0x89); Byte(0xfb);	// mov %rdi, %rbx
+    pending = UnknownLoad;
+    for (i = 0; i < block->numOps; i++) {
+	if (!CompileOp(block, i, &loaded))
+	    break;
+	Retire(pending, loaded);
+	if (IsBranch(block->ops[i].code)) {
+	    pc = block->virtAddr + i * 4;
+	    StoreConstant(PrevPCReg, pc);
+	    StoreConstant(PCReg, pc + 4);
+	}
+	pending = loaded;
+    }
+    if (i == 0)
+	return;
+    Exit(block, i);
+
+    block->native = (NativeCode) start;
+    used = code - codeCache;
+    numCompiled++;
+    DEBUG('e', "Compiled %d of %d instructions of block at 0x%x, %d bytes\n",
+	  i, block->numOps, block->virtAddr, (int) (code - start));
+}
+
+//----------------------------------------------------------------------
+// JitCompiler::CompileOp
+// 	Compile the body of micro-op "index" of "block": everything up
+//	to retiring it.  Return FALSE, without generating anything, if
+//	we don't compile this micro-op.
+//
+//	"loaded" -- set to the register this micro-op loads (its value
+//		is left in %edx), or NoLoad
+//----------------------------------------------------------------------
+
+bool
+JitCompiler::CompileOp(TranslatedBlock *block, int index, int *loaded)
+{
+    MicroOp *op = &block->ops[index];
+    int pc = block->virtAddr + index * 4;
+
+    *loaded = NoLoad;
+    switch (op->code) {
+      case UOP_NOP:
+	break;
+      case UOP_LI:
+	StoreConstant(op->rd, op->imm);
+	break;
+      case UOP_MOVE:
+	Load(EAX, op->rs);
+	Store(op->rd, EAX);
+	break;
+      case UOP_ADDIU:
+      case UOP_ANDI:
+      case UOP_ORI:
+      case UOP_XORI:
+	Load(EAX, op->rs);
+	switch (op->code) {
+	  case UOP_ADDIU: Byte(0x05); break;	// add $imm, %eax
+	  case UOP_ANDI: Byte(0x25); break;	// and $imm, %eax
+	  case UOP_ORI: Byte(0x0d); break;	// or $imm, %eax
+	  case UOP_XORI: Byte(0x35); break;	// xor $imm, %eax
+	}
+	Word(op->imm);
+	Store(op->rd, EAX);
+	break;
+      case UOP_ADDU:
+      case UOP_SUBU:
+      case UOP_AND:
+      case UOP_XOR:
+      case UOP_NOR:
+	Load(EAX, op->rs);
+	switch (op->code) {
+	  case UOP_ADDU: Arith(0x03, EAX, op->rt); break;
+	  case UOP_SUBU: Arith(0x2b, EAX, op->rt); break;
+	  case UOP_AND: Arith(0x23, EAX, op->rt); break;
+	  case UOP_XOR: Arith(0x33, EAX, op->rt); break;
+	  case UOP_NOR:
+	    Arith(0x0b, EAX, op->rt);
+	    Byte(0xf7); Byte(0xd0);		// not %eax
+	    break;
+	}
+	Store(op->rd, EAX);
+	break;
+      case UOP_SLT:
+      case UOP_SLTU:
+      case UOP_SLTI:
+      case UOP_SLTIU:
+	Load(ECX, op->rs);
+	Byte(0x31); Byte(0xc0);			// xor %eax, %eax
+	if (op->code == UOP_SLT || op->code == UOP_SLTU)
+	    Arith(0x3b, ECX, op->rt);		// cmp registers[rt], %ecx
+	else {
+	    Byte(0x81); Byte(0xf9); Word(op->imm);	// cmp $imm, %ecx
+	}
+	Byte(0x0f);
+	if (op->code == UOP_SLT || op->code == UOP_SLTI)
+	    Byte(0x9c);				// setl %al
+	else
+	    Byte(0x92);				// setb %al
+	Byte(0xc0);
+	Store(op->rd, EAX);
+	break;
+      case UOP_SLL:
+      case UOP_SRA:
+	Load(EAX, op->rt);
+	Byte(0xc1);				// shl/sar $imm, %eax
+	Byte(op->code == UOP_SLL ? 0xe0 : 0xf8);
+	Byte(op->imm & 0x1f);
+	Store(op->rd, EAX);
+	break;
+      case UOP_SLLV:
+      case UOP_SRAV:
+	Load(ECX, op->rs);
+	Load(EAX, op->rt);
+	Byte(0xd3);				// shl/sar %cl, %eax
+	Byte(op->code == UOP_SLLV ? 0xe0 : 0xf8);
+	Store(op->rd, EAX);
+	break;
+      case UOP_MFHI:
+      case UOP_MFLO:
+	Load(EAX, op->code == UOP_MFHI ? HiReg : LoReg);
+	Store(op->rd, EAX);
+	break;
+
+      case UOP_LW:
+      case UOP_LB:
+      case UOP_LBU:
+	Load(EAX, op->rs);
+	Byte(0x05); Word(op->imm);		// add $imm, %eax
+	Byte(0x89); Byte(0xc7);			// mov %eax, %edi
+	Byte(0xbe); Word(op->code == UOP_LW ? 4 : 1);	// mov $size, %esi
+	Call((void *) LoadHelper);
+	Byte(0x48); Byte(0x85); Byte(0xc0);	// test %rax, %rax
+	ExitUnless(JNS, block, index);
+	if (op->code == UOP_LW) {
+	    Byte(0x89); Byte(0xc2);		// mov %eax, %edx
+	} else {
+	    Byte(0x0f);				// movsbl/movzbl %al, %edx
+	    Byte(op->code == UOP_LB ? 0xbe : 0xb6);
+	    Byte(0xd0);
+	}
+	*loaded = op->rt;
+	break;
+      case UOP_SW:
+      case UOP_SB:
+	Load(EAX, op->rs);
+	Byte(0x05); Word(op->imm);		// add $imm, %eax
+	Byte(0x89); Byte(0xc7);			// mov %eax, %edi
+	Byte(0xbe); Word(op->code == UOP_SW ? 4 : 1);	// mov $size, %esi
+	Load(EDX, op->rt);
+	Call((void *) StoreHelper);
+	Byte(0x85); Byte(0xc0);			// test %eax, %eax
+	ExitUnless(JNE, block, index);
+	break;
+
+      // Branches: set NextPC to the fall-through address, then skip
+      // the (10 byte) store of the target if the branch isn't taken.
+      case UOP_BEQ:
+      case UOP_BNE:
+	StoreConstant(NextPCReg, pc + 8);
+	Load(EAX, op->rs);
+	Arith(0x3b, EAX, op->rt);		// cmp registers[rt], %eax
+	Byte(op->code == UOP_BEQ ? JNE : JE);
+	Byte(10);
+	StoreConstant(NextPCReg, op->imm);
+	break;
+      case UOP_BLEZ:
+      case UOP_BGTZ:
+      case UOP_BLTZ:
+      case UOP_BGEZ:
+	StoreConstant(NextPCReg, pc + 8);
+	Byte(0x83); Byte(0xbb); Word(op->rs * 4); Byte(0); // cmpl $0, registers[rs]
+	switch (op->code) {
+	  case UOP_BLEZ: Byte(JG); break;
+	  case UOP_BGTZ: Byte(JLE); break;
+	  case UOP_BLTZ: Byte(JGE); break;
+	  case UOP_BGEZ: Byte(JL); break;
+	}
+	Byte(10);
+	StoreConstant(NextPCReg, op->imm);
+	break;
+      case UOP_JAL:
+	StoreConstant(RetAddrReg, pc + 8);
+      case UOP_J:
+	StoreConstant(NextPCReg, op->imm);
+	break;
+      case UOP_JALR:
+	StoreConstant(op->rd, pc + 8);
+      case UOP_JR:
+	Load(EAX, op->rs);
+	Store(NextPCReg, EAX);
+	if (op->code == UOP_JALR && op->rd == 0)
+	    StoreConstant(0, 0);
+	break;
+
+      default:
+	return FALSE;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// JitCompiler::Retire
+// 	Generate the code to retire an instruction, as at the end of
+//	Machine::OneInstruction: do the delayed load that was pending
+//	when the instruction started, and record the one it started.
+//	The program counters are handled by our callers.
+//
+//	"pending" -- the register being loaded when the instruction
+//		started, NoLoad, or UnknownLoad
+//	"loaded" -- the register the instruction loads (with the value
+//		in %edx), or NoLoad
+//----------------------------------------------------------------------
+
+void
+JitCompiler::Retire(int pending, int loaded)
+{
+    if (pending == UnknownLoad) {
+	Load(EAX, LoadReg);
+	Load(ECX, LoadValueReg);
+	Byte(0x89); Byte(0x0c); Byte(0x83);	// mov %ecx, (%rbx,%rax,4)
+	StoreConstant(0, 0);
+    } else if (pending > 0) {		// a load into r0 has no effect
+	Load(ECX, LoadValueReg);
+	Store(pending, ECX);
+    }
+    if (loaded != NoLoad) {
+	StoreConstant(LoadReg, loaded);
+	Store(LoadValueReg, EDX);
+    } else if (pending != NoLoad) {
+	StoreConstant(LoadReg, 0);
+	StoreConstant(LoadValueReg, 0);
+    }
+}
+
+//----------------------------------------------------------------------
+// JitCompiler::Exit
+// 	Generate the code to return to the interpreter, after "done"
+//	instructions of "block" have been retired.  Bring the program
+//	counters up to date first.  They are already right if nothing
+//	has been done yet, or the last thing done was a branch.
+//----------------------------------------------------------------------
+
+void
+JitCompiler::Exit(TranslatedBlock *block, int done)
+{
+    int pc = block->virtAddr + done * 4;
+
+    if (done > 0 && !IsBranch(block->ops[done - 1].code)) {
+	StoreConstant(PrevPCReg, pc - 4);
+	if (done > 1 && IsBranch(block->ops[done - 2].code)) {
+	    Load(EAX, NextPCReg);		// just did the delay slot
+	    Store(PCReg, EAX);
+	    Byte(0x83); Byte(0xc0); Byte(4);	// add $4, %eax
+	    Store(NextPCReg, EAX);
+	} else {
+	    StoreConstant(PCReg, pc);
+	    StoreConstant(NextPCReg, pc + 4);
+	}
+    }
+    Byte(0xb8); Word(done);			// mov $done, %eax
+    Byte(0x5b);					// pop %rbx
+    Byte(0xc3);					// ret
+}
+
+//----------------------------------------------------------------------
+// JitCompiler::ExitUnless
+// 	Generate a conditional jump around an exit to the interpreter,
+//	taken if the last test succeeded.
+//----------------------------------------------------------------------
+
+void
+JitCompiler::ExitUnless(int jumpOpCode, TranslatedBlock *block, int done)
+{
+    unsigned char *offset;
+
+    Byte(jumpOpCode);
+    offset = code;
+    Byte(0);
+    Exit(block, done);
+    *offset = code - (offset + 1);
+}
+
+//----------------------------------------------------------------------
+// Emitting instructions
+//	Byte, Word and Pointer append 1, 4 or 8 bytes to the code
+//	(least significant first).  The rest each generate one
+//	instruction accessing a simulated register, ie, a 32-bit
+//	displacement from %rbx.
+//----------------------------------------------------------------------
+
+void
+JitCompiler::Byte(int b)
+{
+    *code++ = (unsigned char) b;
+}
+
+void
+JitCompiler::Word(int w)
+{
+    for (int i = 0; i < 4; i++)
+	Byte((unsigned) w >> (8 * i));
+}
+
+void
+JitCompiler::Pointer(void *p)
+{
+    int64_t value = (int64_t) (long) p;
+
+    Word((int) value);
+    Word((int) (value >> 32));
+}
+
+void
+JitCompiler::Arith(int opCode, int hostReg, int reg)
+{
+    Byte(opCode);				// op reg*4(%rbx), %hostReg
+    Byte(0x83 | (hostReg << 3));
+    Word(reg * 4);
+}
+
+void
+JitCompiler::Load(int hostReg, int reg)
+{
+    Arith(0x8b, hostReg, reg);			// mov
+}
+
+void
+JitCompiler::Store(int reg, int hostReg)
+{
+    Arith(0x89, hostReg, reg);			// mov %hostReg, reg*4(%rbx)
+}
+
+void
+JitCompiler::StoreConstant(int reg, int value)
+{
+    Arith(0xc7, 0, reg);			// movl $value, reg*4(%rbx)
+    Word(value);
+}
+
+void
+JitCompiler::Call(void *function)
+{
+    Byte(0x48); Byte(0xb8); Pointer(function);	// mov $function, %rax
+    Byte(0xff); Byte(0xd0);			// call *%rax
+}
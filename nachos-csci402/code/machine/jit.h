@@ -0,0 +1,66 @@
+// jit.h
+//	Data structures for the JIT engine, which compiles the busiest
+//	translated blocks (see blockcache.h) into host machine code.
+//
+//	A block is compiled once it has been run JitThreshold times.
+//	The compiled code works directly on Machine::registers, and
+//	does exactly what the block's micro-ops would do, including
+//	the delayed load and the program counters.  It never enters
+//	the kernel: whenever it meets something it can't do on its
+//	own -- an instruction we don't compile, a memory access that
+//	would raise an exception, a store into translated code -- it
+//	stops and reports how many instructions it finished, and the
+//	interpreter carries on from there.  Likewise, compiled code
+//	doesn't check for interrupts, so it is only run when no
+//	interrupt can fall due before the end of the block.
+//
+//	Compiled code is only generated on x86-64 hosts; elsewhere the
+//	JIT engine behaves just like the block engine.
+
+#ifndef JIT_H
+#define JIT_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "blockcache.h"
+
+#define JitThreshold	16		// runs of a block before we compile it
+#define JitCacheSize	(1024 * 1024)	// bytes of host code we keep
+#define JitMaxOpSize	192		// most host code for one micro-op
+
+class JitCompiler {
+  public:
+    JitCompiler(BlockCache *cache);	// "cache" holds the blocks we compile
+    ~JitCompiler();
+
+    void Compile(TranslatedBlock *block);
+				// Set block->native, if there is anything
+				// in the block worth compiling.  If we
+				// have run out of room, every block in
+				// the cache is thrown away instead
+				// (including "block")
+
+  private:
+    // Emitting host code at "code"
+    void Byte(int b);
+    void Word(int w);
+    void Pointer(void *p);
+    void Load(int hostReg, int reg);	// hostReg = registers[reg]
+    void Store(int reg, int hostReg);	// registers[reg] = hostReg
+    void StoreConstant(int reg, int value); // registers[reg] = value
+    void Arith(int opCode, int hostReg, int reg); // hostReg op= registers[reg]
+    void Call(void *function);
+    void Retire(int pending, int loaded);
+    void Exit(TranslatedBlock *block, int done);
+    void ExitUnless(int jumpOpCode, TranslatedBlock *block, int done);
+    bool CompileOp(TranslatedBlock *block, int index, int *loaded);
+
+    BlockCache *blockCache;	// to flush, when we run out of room
+    unsigned char *codeCache;	// executable memory for compiled code
+    int used;			// bytes of "codeCache" in use
+    unsigned char *code;	// where the next byte of code goes
+    int numCompiled;		// statistics, for debugging
+    int numFlushes;
+};
+
+#endif // JIT_H
@@ -9,6 +9,8 @@
 
 #include "copyright.h"
 #include "machine.h"
+#include "blockcache.h"
+#include "jit.h"
 #include "system.h"
 
 // Textual names of the exceptions that can be generated by user program
@@ -50,35 +52,77 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"cpuEngine" -- which execution engine Run() should use
+//	"verify" -- if non-zero, check the engine against the reference
+//		simulator at least this often (in instructions)
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, CPUEngine cpuEngine, int verify, int physPages,
+		 bool hugePages)
 {
     int i;
 
     for (i = 0; i < NumTotalRegs; i++)
         registers[i] = 0;
-    mainMemory = new char[MemorySize];
-    for (i = 0; i < MemorySize; i++)
-      	mainMemory[i] = 0;
+    ASSERT(physPages > 0 && physPages <= MaxPhysPages);
+    numPhysPages = physPages;
+    memorySize = numPhysPages * PageSize;
+    mainMemory = AllocZeroedMemory(memorySize, hugePages);
 	
-    //Set the machine memory ticks for every page to 0
-    for(i=0; i< NumPhysPages; i++)
-    {
-      lastUsed[i] = stats->totalTicks;
+    // Nothing has been used yet
+    lastUsed = new int64_t[numPhysPages];
+    pageAge = new unsigned int[numPhysPages];
+    referenced = new bool[numPhysPages];
+    for (i = 0; i < numPhysPages; i++) {
+	lastUsed[i] = stats->totalTicks;
+	pageAge[i] = 0;
+	referenced[i] = FALSE;
     }
 
-#ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
-	tlb[i].valid = FALSE;
-    pageTable = NULL;
-#else	// use linear page table
+    // Nothing has been predecoded yet
+    decodeCache = new Instruction[memorySize / 4];
+    pageDecoded = new bool[numPhysPages];
+    for (i = 0; i < numPhysPages; i++)
+	pageDecoded[i] = FALSE;
+
     tlb = NULL;
+    tlbSize = 0;
+    asid = 0;
+    tlbHand = NULL;
+    tlbReferenced = NULL;
     pageTable = NULL;
-#endif
+#ifdef USE_TLB
+    ConfigureTLB(TLBSize, TLBSize, RandomTLB);
+#endif	// otherwise, use linear page table
 
     singleStep = debug;
+    FlushTranslations();
+    Specialize();
+    batchLeft = batchDone = 0;
+    spinSkipped = 0;
+    for (i = 0; i < NumFusions; i++)
+	fusionCount[i] = 0;
+    engine = cpuEngine;
+    if (engine == BlockEngine || engine == JitEngine)
+	blockCache = new BlockCache(mainMemory, numPhysPages);
+    else
+	blockCache = NULL;
+    if (engine == JitEngine)
+	jit = new JitCompiler(blockCache);
+    else
+	jit = NULL;
+    verifyInterval = verify;
+    shadowing = FALSE;
+    numVerified = numDiverged = 0;
+    if (verifyInterval > 0) {
+	shadowMemory = new char[memorySize];
+	shadowDecoded = new bool[numPhysPages];
+	for (i = 0; i < numPhysPages; i++)
+	    shadowDecoded[i] = FALSE;
+    } else {
+	shadowMemory = NULL;
+	shadowDecoded = NULL;
+    }
     CheckEndian();
 }
 
@@ -87,15 +131,116 @@ Machine::Machine(bool debug)
 // Machine::getTimeUsed 
 // 	Return the time this page was last used. Returns -1 if the pageNo passed
 //      was invalid. 
+//
+//	Memory accesses don't record the time (that would cost a store on
+//	every one of them); instead, SampleUseBits notes when it finds a
+//	page has been used, so the time is only as accurate as the 
+//	interval between samples.
 //----------------------------------------------------------------------
-int Machine::getTimeUsed(int pageNo)
+int64_t Machine::getTimeUsed(int pageNo)
 {
-	if (pageNo <0 || pageNo >= NumPhysPages) return -1;
+	if (pageNo <0 || pageNo >= numPhysPages) return -1;
 
 	else return this->lastUsed[pageNo]; 
 
 }
 
+//----------------------------------------------------------------------
+// Machine::getAge
+// 	Return the aging counter of physical page "pageNo" (0 if it 
+//	isn't one): its top bit says whether the page was used in the
+//	most recent interval between calls to AgePages, the next bit the
+//	interval before that, and so on.  So the page with the smallest
+//	counter is the best approximation to the least recently used.
+//----------------------------------------------------------------------
+
+unsigned int
+Machine::getAge(int pageNo)
+{
+    if (pageNo < 0 || pageNo >= numPhysPages)
+	return 0;
+    return pageAge[pageNo];
+}
+
+//----------------------------------------------------------------------
+// Machine::SampleUseBits
+// 	Note which frames have been used through the valid entries of
+//	"table", and when, and clear their use bits, so that each use 
+//	counts in exactly one aging interval.
+//
+//	Translations remembered by ReadMem and WriteMem don't set use 
+//	bits, so if we clear any, we forget them all; the next access to
+//	each page then sets its use bit again.  (A translation is only
+//	remembered by an access that sets the use bit, so if none are
+//	set, there is nothing to forget.)
+//
+//	"table" -- a page table, or part of the TLB
+//	"size" -- the number of entries in it
+//----------------------------------------------------------------------
+
+void
+Machine::SampleUseBits(TranslationEntry *table, int size)
+{
+    int i, frame, pages;
+    bool cleared = FALSE;
+
+    for (i = 0; i < size; i++)
+	if (table[i].valid && table[i].use) {
+	    pages = (tlb != NULL && table[i].superPage) ? SuperPageSize : 1;
+	    for (frame = table[i].physicalPage;
+		 frame < table[i].physicalPage + pages; frame++)
+		if (frame < numPhysPages) {
+		    referenced[frame] = TRUE;
+		    lastUsed[frame] = Now();
+		}
+	    table[i].use = FALSE;
+	    cleared = TRUE;
+	}
+    if (cleared)
+	FlushTranslations();
+}
+
+//----------------------------------------------------------------------
+// Machine::SampleUses
+// 	Sample the use bits of the running address space's page table,
+//	and of the TLB, bringing getTimeUsed up to date, without aging 
+//	the frames.  The page replacement code calls this before it 
+//	compares use times; only the page aging clock (AgePages) shifts
+//	the aging counters, so each of their bits covers the same amount
+//	of time, however often we evict.
+//----------------------------------------------------------------------
+
+void
+Machine::SampleUses()
+{
+    if (pageTable != NULL)
+	SampleUseBits(pageTable, pageTableSize);
+    if (tlb != NULL)
+	SampleUseBits(tlb, tlbSize);
+}
+
+//----------------------------------------------------------------------
+// Machine::AgePages
+// 	Sample the use bits of the running address space's page table,
+//	and of the TLB, and shift a bit for each frame into its aging
+//	counter: set if the frame has been used since the last time.
+//----------------------------------------------------------------------
+
+void
+Machine::AgePages()
+{
+    int i;
+
+    SampleUses();
+    for (i = 0; i < numPhysPages; i++) {
+	pageAge[i] >>= 1;
+	if (referenced[i]) {
+	    pageAge[i] |= 1U << 31;
+	    referenced[i] = FALSE;
+	}
+    }
+}
+
 //----------------------------------------------------------------------
 // Machine::~Machine
 // 	De-allocate the data structures used to simulate user program execution.
@@ -103,9 +248,31 @@ int Machine::getTimeUsed(int pageNo)
 
 Machine::~Machine()
 {
-    delete [] mainMemory;
-    if (tlb != NULL)
+    if (engine == ThreadedEngine && DebugIsEnabled('e'))
+	PrintFusions();
+    if (verifyInterval > 0) {
+	printf("Verify: %d checks, %d divergences\n", numVerified,
+	       numDiverged);
+	delete [] shadowMemory;
+	delete [] shadowDecoded;
+    }
+    if (blockCache != NULL)
+	DEBUG('e', "Spinning loops: %lld instructions skipped\n", spinSkipped);
+    FreeZeroedMemory(mainMemory, memorySize);
+    delete [] decodeCache;
+    delete [] pageDecoded;
+    delete [] lastUsed;
+    delete [] pageAge;
+    delete [] referenced;
+    if (jit != NULL)
+	delete jit;
+    if (blockCache != NULL)
+	delete blockCache;
+    if (tlb != NULL) {
         delete [] tlb;
+	delete [] tlbHand;
+	delete [] tlbReferenced;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -121,14 +288,33 @@ Machine::~Machine()
 void
 Machine::RaiseException(ExceptionType which, int badVAddr)
 {
+    if (shadowing) {			// just note it; see Verify
+	shadowException = which;
+	shadowBadVAddr = badVAddr;
+	return;
+    }
+    // With a TLB, the kernel itself can miss, copying to or from
+    // user memory on behalf of a system call.
+    bool fromKernel = (interrupt->getStatus() == SystemMode);
+
+    if (which == PageFaultException && tlb != NULL)
+	stats->numTLBMisses++;
+    if (verifyInterval > 0 && !fromKernel)
+	Verify(SinceCheckpoint(), which, badVAddr);
     DEBUG('m', "Exception: %s\n", exceptionNames[which]);
     
-//  ASSERT(interrupt->getStatus() == UserMode);
     registers[BadVAddrReg] = badVAddr;
+    SyncTicks();			// the kernel sees the right time,
+    batchLeft = 0;			// and may schedule new interrupts
     DelayedLoad(0, 0);			// finish anything in progress
     interrupt->setStatus(SystemMode);
     ExceptionHandler(which);		// interrupts are enabled at this point
+    FlushTranslations();		// the kernel may have changed them
+    if (fromKernel)
+	return;
     interrupt->setStatus(UserMode);
+    if (verifyInterval > 0)
+	Checkpoint(1);			// the caller has yet to Tick
 }
 
 //----------------------------------------------------------------------
@@ -34,9 +34,18 @@ using namespace std;
 					// the disk sector size, for
 					// simplicity
 
-#define NumPhysPages    32
-#define MemorySize 	(NumPhysPages * PageSize)
+#define NumPhysPages    32		// by default; see Machine::numPhysPages
+#define MaxPhysPages	(1 << 23)	// so that physical addresses fit
+					// in an int
 #define TLBSize		4		// if there is a TLB, make it small
+#define InstrsPerPage	(PageSize / 4)	// instruction words in one page
+#define NumASIDs	64		// address space IDs for tagging TLB
+					// entries, see Machine::asid
+#define SuperPageSize	16		// pages mapped by a TLB entry with
+					// its superPage bit set; a power 
+					// of two
+#define SoftTLBSize	64		// recent translations kept by ReadMem
+					// and WriteMem; a power of two
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -54,6 +63,32 @@ enum ExceptionType { NoException,           // Everything ok!
 		     NumExceptionTypes
 };
 
+// How the TLB entry to replace is chosen, on a TLB miss (see 
+// Machine::TLBVictim)
+
+enum TLBPolicy { RandomTLB,		// any entry in the set
+		 FifoTLB,		// the one loaded longest ago
+		 ClockTLB		// the next one not used since the
+					// clock hand last passed it
+};
+
+// The ways we know how to execute user instructions.  They all have
+// exactly the same visible behavior; the reference engine is the 
+// original one-instruction-at-a-time simulator, and is what the 
+// others are checked against.
+
+enum CPUEngine { ReferenceEngine,	// switch on each decoded opcode
+		 ThreadedEngine,	// jump straight to each opcode's
+					// handler, without leaving the loop
+		 BlockEngine,		// run cached translations of whole
+					// basic blocks
+		 JitEngine		// the same, but compile the busiest
+					// blocks to host machine code
+};
+
+class BlockCache;
+class JitCompiler;
+
 // User program CPU state.  The full set of MIPS registers, plus a few
 // more because we need to be able to start/stop a user program between
 // any two instructions (thus we need to keep track of things like load
@@ -73,6 +108,22 @@ enum ExceptionType { NoException,           // Everything ok!
 
 #define NumTotalRegs 	40
 
+// Superinstructions: common pairs of consecutive instructions that
+// the predecoder recognizes, so that the threaded engine can run both
+// with a single dispatch.  The first instruction of the pair is
+// marked with one of these.
+
+#define FUSE_NONE	0	// not the start of a superinstruction
+#define FUSE_LUI_ADDIU	1	// lui r; addiu s,r,n -- a 32-bit constant
+#define FUSE_LUI_ORI	2	// lui r; ori s,r,n -- ditto
+#define FUSE_LW_NOP	3	// lw; nop -- a load and its delay slot
+#define FUSE_SLT_BRANCH	4	// slt[i][u]; beq/bne [; nop] -- compare and
+				// branch, with its delay slot if empty
+#define FUSE_BRANCH_NOP	5	// branch or jump; nop -- an empty delay slot
+#define FUSE_ADDIU_SW	6	// addiu sp,sp,n; sw -- procedure prologue
+#define FUSE_ADDIU_JR	7	// addiu sp,sp,n; jr -- procedure epilogue
+#define NumFusions	8
+
 // The following class defines an instruction, represented in both
 // 	undecoded binary form
 //      decoded to identify
@@ -91,6 +142,21 @@ class Instruction {
     char rs, rt, rd; // Three registers from instruction.
     int extra;       // Immediate or target or shamt field or offset.
                      // Immediates are sign-extended.
+    char fused;	     // FUSE_NONE, or the superinstruction this one
+		     // starts; set by Machine::DecodePage
+};
+
+// A translation remembered by the simulator itself (not the simulated
+// hardware), so that the next access to the same page can skip 
+// Machine::Translate.  An entry is only made once the page's use bit
+// has been set, and is only writable once its dirty bit has been set
+// too, so that skipping Translate never misses an update of either.
+
+class SoftTLBEntry {
+  public:
+    int virtualPage;	// -1 if the entry is empty
+    int frameAddr;	// offset of the page in "mainMemory"
+    bool writable;	// can stores skip Translate too?
 };
 
 // The following class defines the simulated host workstation hardware, as 
@@ -108,8 +174,11 @@ class Instruction {
 
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
-				// for running user programs
+    Machine(bool debug, CPUEngine cpuEngine, int verify, int physPages,
+	    bool hugePages);
+				// Initialize the simulation of the hardware
+				// for running user programs, with 
+				// "physPages" pages of memory
     ~Machine();			// De-allocate the data structures
 
 // Routines callable by the Nachos kernel
@@ -123,18 +192,57 @@ class Machine {
 
 // Routines internal to the machine simulation -- DO NOT call these 
 
-    void OneInstruction(Instruction *instr); 	
+    void OneInstruction(Instruction *instr) 	
+	{ (this->*oneInstruction)(instr); }
     				// Run one instruction of a user program.
+    bool ExecuteInstruction(Instruction *instr)
+	{ return (this->*execute)(instr); }
+				// Execute an already fetched instruction;
+				// return FALSE if it raised an exception.
+    void RunThreaded();		// Run user instructions with the threaded 
+				// engine; never returns
+    void RunBlocks();		// Likewise, with the basic-block engine
+    Instruction *FetchInstruction() { return (this->*fetch)(); }
+				// Return the decoded instruction at PC,
+				// from the predecoded copy of its page.
+				// Return NULL if an exception occurred.
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
+    bool Tick() {		// Advance simulated time by one instruction;
+	if (batchLeft > 0) {	// return TRUE if the kernel got control
+	    batchLeft--;
+	    batchDone++;
+	    return FALSE;
+	}
+	return EndBatch();
+    }
+    void SyncTicks();		// Bring stats->totalTicks up to date with
+				// the instructions counted by Tick
+    int64_t Now();		// The current simulated time
     
-    bool ReadMem(int addr, int size, int* value);
-    bool WriteMem(int addr, int size, int value);
+    bool ReadMem(int addr, int size, int* value)
+	{ return (this->*readMem)(addr, size, value); }
+    bool WriteMem(int addr, int size, int value)
+	{ return (this->*writeMem)(addr, size, value); }
     				// Read or write 1, 2, or 4 bytes of virtual 
 				// memory (at addr).  Return FALSE if a 
 				// correct translation couldn't be found.
+    bool TryReadMem(int addr, int size, int *value);
+    bool TryWriteMem(int addr, int size, int value);
+				// The same, for compiled code: on failure, 
+				// don't raise an exception, leave it to the
+				// interpreter to redo the access
+    int CopyIn(int virtAddr, int len, char *buf)
+	{ return CopyPages(virtAddr, len, buf, FALSE); }
+    int CopyOut(int virtAddr, int len, char *buf)
+	{ return CopyPages(virtAddr, len, buf, TRUE); }
+				// For the kernel: copy "len" bytes of 
+				// virtual memory into or out of "buf",
+				// a page at a time.  Return "len", or -1
+				// if part of the range isn't mapped.
     
-    ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing);
+    ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing)
+	{ return (this->*translate)(virtAddr, physAddr, size, writing); }
     				// Translate an address, and check for 
 				// alignment.  Set the use and dirty bits in 
 				// the translation entry appropriately,
@@ -157,6 +265,8 @@ class Machine {
 
     char *mainMemory;		// physical memory to store user program,
 				// code and data, while executing
+    int numPhysPages;		// the size of "mainMemory", in pages
+    int memorySize;		// and in bytes
     int registers[NumTotalRegs]; // CPU registers, for executing user programs
 
 
@@ -180,18 +290,173 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
+    int tlbSize;			// number of entries in "tlb"
+    int asid;				// ID of the running address space 
+					// (0 to NumASIDs-1); only TLB 
+					// entries tagged with it are used
+
+// The TLB is set-associative: the entries for virtual page "vpn" are
+// the "tlbWays" consecutive entries starting at TLBSet(vpn).  With
+// tlbWays == tlbSize (the default) any page can go in any entry.
+
+    void ConfigureTLB(int size, int ways, TLBPolicy policy);
+				// Replace the TLB with an empty one of
+				// "size" entries, in sets of "ways"
+    int TLBSet(int vpn) { return (vpn % (tlbSize / tlbWays)) * tlbWays; }
+				// first entry where "vpn" may go (for a
+				// superpage, "vpn" is its first page
+				// divided by SuperPageSize)
+    int TLBVictim(int vpn);	// Return the entry the kernel should load
+				// the translation for "vpn" into, 
+				// according to the replacement policy
 
     TranslationEntry *pageTable;
     unsigned int pageTableSize;
 
-   int getTimeUsed( int pageNo );
+    int64_t getTimeUsed(int pageNo);
+				// Return roughly when physical page
+				// "pageNo" was last used (as of the last
+				// sample of its use bit), or -1
+    unsigned int getAge(int pageNo);
+				// Return the aging counter of physical
+				// page "pageNo": the higher, the more
+				// recently and often it has been used
+
+    void SampleUseBits(TranslationEntry *table, int size);
+				// Note which frames the entries of 
+				// "table" have used, and clear their use
+				// bits.  The kernel must call this before
+				// it stops using a page table (or TLB 
+				// entry), so that AgePages sees its uses.
+    void SampleUses();		// Sample the use bits of the page table
+				// and TLB, to bring getTimeUsed up to 
+				// date, without aging any frame
+    void AgePages();		// Sample the use bits of the page table
+				// and TLB, and age every frame; called
+				// periodically (by the page aging clock)
+
+    void FlushTranslations();	// Forget the translations remembered by
+				// ReadMem and WriteMem.  The kernel must
+				// call this when it changes the page
+				// table or TLB, other than while handling
+				// an exception or interrupt (after which
+				// we flush them anyway).
+
+    void InvalidateCode(int ppn);
+				// Forget any predecoded or translated 
+				// code from physical page "ppn"; the kernel
+				// must call this whenever it writes 
+				// "mainMemory" directly or reassigns or 
+				// frees the frame.
 
   private:
+    CPUEngine engine;		// how Run() executes instructions
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
     int64_t runUntilTime;		// drop back into the debugger when simulated
 				// time reaches this value
-    int64_t lastUsed[NumPhysPages]; //This is the time stamp of when the page was last used.
+    int64_t *lastUsed;		// when SampleUseBits last found each
+				// frame had been used
+    unsigned int *pageAge;	// one bit per call to AgePages, most
+				// recent first: was the frame used?
+    bool *referenced;		// used since the last call to AgePages
+
+    int tlbWays;		// entries in each set of the TLB
+    TLBPolicy tlbPolicy;	// how TLBVictim chooses
+    int *tlbHand;		// next entry to consider, for each set
+				// (FIFO and clock)
+    bool *tlbReferenced;	// entries used since the clock hand passed
+
+    SoftTLBEntry softTLB[SoftTLBSize]; // recent translations, by
+				// virtual page number, see FlushTranslations
+    int CopyPages(int virtAddr, int len, char *buf, bool writing);
+				// the work of CopyIn and CopyOut
+
+    bool SoftTranslate(int virtAddr, int size, bool writing, int *physAddr)
+    {				// Translate from "softTLB", or return 
+				// FALSE if Translate has to be called
+	unsigned int vpn = (unsigned) virtAddr / PageSize;
+	SoftTLBEntry *entry = &softTLB[vpn % SoftTLBSize];
+
+	if (entry->virtualPage != (int) vpn || (virtAddr & (size - 1))
+		|| (writing && !entry->writable))
+	    return FALSE;
+	*physAddr = entry->frameAddr + (unsigned) virtAddr % PageSize;
+	return TRUE;
+    }
+
+    Instruction *decodeCache;	// one decoded instruction per word of
+				// "mainMemory", valid for decoded pages
+    bool *pageDecoded;		// is "decodeCache" valid for each page?
+    void DecodePage(int ppn);	// fill "decodeCache" for a physical page
+    void RedecodeWord(int physAddr); // refresh one word after a store
+
+    int batchLeft;		// instructions Tick can count before an
+				// interrupt might be due
+    int batchDone;		// instructions counted, but not yet added
+				// to the statistics
+    bool EndBatch();		// Tick, when the batch has run out
+    int64_t spinSkipped;	// instructions of spinning loops that the
+				// block engine counted without running
+
+    int fusionCount[NumFusions]; // how often each superinstruction ran
+    void PrintFusions();	// report "fusionCount"
+
+    // The reference engine, compiled once for each combination of
+    // "trace" (debugging output for 'a' or 'm' may be wanted),
+    // "useTLB" (there is a TLB rather than a page table) and, for
+    // the main loop, "stepping" (drop into the debugger after each
+    // instruction).  None of these conditions is then tested at run
+    // time, and the DEBUG calls vanish from the usual versions.
+    template <bool trace, bool useTLB>
+	void DoOneInstruction(Instruction *instr);
+    template <bool trace, bool useTLB>
+	bool DoExecute(Instruction *instr);
+    template <bool trace, bool useTLB>
+	Instruction *DoFetch();
+    template <bool trace, bool useTLB>
+	bool DoReadMem(int addr, int size, int* value);
+    template <bool trace, bool useTLB>
+	bool DoWriteMem(int addr, int size, int value);
+    template <bool trace, bool useTLB>
+	ExceptionType DoTranslate(int virtAddr, int* physAddr, int size,
+				  bool writing);
+    template <bool trace, bool useTLB, bool stepping>
+	void RunReference(Instruction *instr);
+
+    void Specialize();		// Point the routines below at the versions
+				// for the current configuration
+    void (Machine::*oneInstruction)(Instruction *instr);
+    bool (Machine::*execute)(Instruction *instr);
+    Instruction *(Machine::*fetch)();
+    bool (Machine::*readMem)(int addr, int size, int* value);
+    bool (Machine::*writeMem)(int addr, int size, int value);
+    ExceptionType (Machine::*translate)(int virtAddr, int* physAddr,
+					int size, bool writing);
+    void (Machine::*runReference)(Instruction *instr);
+
+    // Checking the engine against the reference simulator (see
+    // verify.cc)
+    int verifyInterval;		// with -verify, the most instructions
+				// between checks; otherwise 0
+    char *shadowMemory;		// the reference simulator's copy of
+    int shadowRegisters[NumTotalRegs]; // memory and the registers
+    int64_t checkpointTime;	// when they were copied
+    bool shadowing;		// is the reference simulator running?
+    Instruction shadowInstr;	// the instruction it is executing
+    bool *shadowDecoded;	// stands in for "pageDecoded" while it 
+				// runs: no page is predecoded
+    ExceptionType shadowException; // the exception it raised, if any
+    int shadowBadVAddr;
+    int numVerified, numDiverged; // statistics
+    void Checkpoint(int pending); // copy memory and registers
+    int SinceCheckpoint();	// instructions counted since then
+    void Verify(int count, ExceptionType which, int badVAddr);
+				// check the engine's last "count"
+				// instructions
+
+    BlockCache *blockCache;	// translated blocks, for the block engine
+    JitCompiler *jit;		// compiles hot blocks, for the JIT engine
 };
 
 extern void ExceptionHandler(ExceptionType which);
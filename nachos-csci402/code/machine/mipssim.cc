@@ -14,9 +14,9 @@
 
 #include "machine.h"
 #include "mipssim.h"
+#include "blockcache.h"
 #include "system.h"
 
-static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 
 //----------------------------------------------------------------------
 // Machine::Run
@@ -35,14 +35,156 @@ Machine::Run()
     if(DebugIsEnabled('m'))
         cout << "Starting thread \"" << currentThread->getName() << "\" at time " << hex << stats->totalTicks << endl;
     interrupt->setStatus(UserMode);
+    batchLeft = 0;			// start a new batch; see Tick
+    FlushTranslations();
+    if (verifyInterval > 0)
+	Checkpoint(0);
+    if (!singleStep && !DebugIsEnabled('m')) {
+	if (engine == ThreadedEngine)	// the debugger and instruction
+	    RunThreaded();		// traces are only supported by the
+	else if (engine == BlockEngine	// reference engine
+		 || engine == JitEngine)
+	    RunBlocks();
+    }
+    for (;;) {
+	Specialize();			// singleStep may have changed
+	(this->*runReference)(instr);
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::RunReference
+// 	The main loop of the reference engine.  If "stepping", we drop
+//	into the debugger after each instruction, and return to Run once
+//	the user has told it to stop single-stepping; otherwise we never
+//	return.
+//----------------------------------------------------------------------
+
+template <bool trace, bool useTLB, bool stepping>
+void
+Machine::RunReference(Instruction *instr)
+{
     for (;;) {
-        OneInstruction(instr);
-	interrupt->OneTick();
-	if (singleStep && (runUntilTime <= stats->totalTicks))
-	  Debugger();
+        DoOneInstruction<trace, useTLB>(instr);
+	Tick();
+	if (stepping) {
+	    if (runUntilTime <= stats->totalTicks)
+		Debugger();
+	    if (!singleStep)
+		return;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::Specialize
+// 	Choose the versions of the reference engine's routines (see
+//	machine.h) to use from now on.  Called when the machine is
+//	built, and by Run, since the debugger can turn single-stepping
+//	off.  The debugging flags are fixed before the machine is built, 
+//	and so is the choice between a TLB and a page table.
+//----------------------------------------------------------------------
+
+#define CHOOSE(trace, useTLB)						\
+    oneInstruction = &Machine::DoOneInstruction<trace, useTLB>;		\
+    execute = &Machine::DoExecute<trace, useTLB>;			\
+    fetch = &Machine::DoFetch<trace, useTLB>;				\
+    readMem = &Machine::DoReadMem<trace, useTLB>;			\
+    writeMem = &Machine::DoWriteMem<trace, useTLB>;			\
+    translate = &Machine::DoTranslate<trace, useTLB>;			\
+    if (singleStep)							\
+	runReference = &Machine::RunReference<trace, useTLB, true>;	\
+    else								\
+	runReference = &Machine::RunReference<trace, useTLB, false>;
+
+void
+Machine::Specialize()
+{
+    bool trace = DebugIsEnabled('a') || DebugIsEnabled('m');
+
+    if (!trace && tlb == NULL) {
+	CHOOSE(false, false)
+    } else if (!trace) {
+	CHOOSE(false, true)
+    } else if (tlb == NULL) {
+	CHOOSE(true, false)
+    } else {
+	CHOOSE(true, true)
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::EndBatch
+// 	Advance simulated time by one instruction, the slow way, and
+//	start a new batch.  Called by Tick when the current batch of
+//	instructions has run out.
+//
+//	Calling interrupt->OneTick() after every instruction is 
+//	expensive, and almost always does nothing but advance the
+//	clock.  Instead, Tick just counts instructions, up to the 
+//	last one after which no interrupt can yet be due.  Simulated
+//	time is brought up to date in one go at the end of the batch,
+//	or earlier if the kernel is entered (RaiseException), so
+//	timing is exactly the same as with OneTick.  (With 'i' 
+//	debugging or single-stepping we tick one at a time as before.)
+//
+//	Returns TRUE if the kernel got control (see Interrupt::OneTick).
+//----------------------------------------------------------------------
+
+bool
+Machine::EndBatch()
+{
+    bool ranKernel;
+    int64_t ahead;
+
+    SyncTicks();
+    if (verifyInterval > 0)		// the kernel may be about to run
+	Verify(SinceCheckpoint() + 1, NoException, 0);
+    ranKernel = interrupt->OneTick();
+    if (ranKernel)
+	FlushTranslations();		// the kernel may have changed them
+    if (verifyInterval > 0)
+	Checkpoint(0);
+
+    batchLeft = 0;
+    if (!singleStep && !DebugIsEnabled('i') && !DebugIsEnabled('m')) {
+	ahead = (interrupt->NextDue() - stats->totalTicks - 1) / UserTick;
+	if (ahead > 0x3fffffff)
+	    batchLeft = 0x3fffffff;
+	else if (ahead > 0)
+	    batchLeft = (int) ahead;
+	if (verifyInterval > 0 && batchLeft > verifyInterval)
+	    batchLeft = verifyInterval;
+    }
+    return ranKernel;
+}
+
+//----------------------------------------------------------------------
+// Machine::SyncTicks
+// 	Add the instructions Tick has counted so far to the statistics.
+//----------------------------------------------------------------------
+
+void
+Machine::SyncTicks()
+{
+    if (batchDone > 0) {
+	interrupt->AdvanceTicks(batchDone);
+	batchDone = 0;
     }
 }
 
+//----------------------------------------------------------------------
+// Machine::Now
+// 	Return the current simulated time, including the instructions
+//	Tick has counted but not yet added to stats->totalTicks.
+//----------------------------------------------------------------------
+
+int64_t
+Machine::Now()
+{
+    return stats->totalTicks + batchDone * UserTick;
+}
+
 
 //----------------------------------------------------------------------
 // TypeToReg
@@ -67,7 +209,7 @@ TypeToReg(RegType reg, Instruction *instr)
 }
 
 //----------------------------------------------------------------------
-// Machine::OneInstruction
+// Machine::DoOneInstruction
 // 	Execute one instruction from a user-level program
 //
 // 	If there is any kind of exception or interrupt, we invoke the 
@@ -87,23 +229,23 @@ TypeToReg(RegType reg, Instruction *instr)
 //	leaving.  This allows the Nachos kernel to control our behavior
 //	by controlling the contents of memory, the translation table,
 //	and the register set.
+//
+//	Like the other Do... routines, this is instantiated once for
+//	each configuration (see Machine::Specialize); OneInstruction
+//	calls the right one.
 //----------------------------------------------------------------------
 
+template <bool trace, bool useTLB>
 void
-Machine::OneInstruction(Instruction *instr)
+Machine::DoOneInstruction(Instruction *instr)
 {
-    int raw;
-    int nextLoadReg = 0; 	
-    int nextLoadValue = 0; 	// record delayed load operation, to apply
-				// in the future
-
     // Fetch instruction 
-    if (!machine->ReadMem(registers[PCReg], 4, &raw))
+    Instruction *decoded = DoFetch<trace, useTLB>();
+    if (decoded == NULL)
 	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
+    *instr = *decoded;
 
-    if (DebugIsEnabled('m')) {
+    if (trace && DebugIsEnabled('m')) {
       struct OpString *str = &opStrings[(int)instr->opCode];
 
       ASSERT(instr->opCode <= MaxOpcode);
@@ -113,6 +255,29 @@ Machine::OneInstruction(Instruction *instr)
       printf("\n");
     }
     
+    (void) DoExecute<trace, useTLB>(instr);
+}
+
+//----------------------------------------------------------------------
+// Machine::DoExecute
+// 	Execute an instruction that has already been fetched from the
+//	current PC and decoded, and advance the program counters.
+//
+//	Returns FALSE if the instruction raised an exception, in which
+//	case the kernel has already handled it, and the registers are
+//	as the kernel left them.
+//
+//	"instr" -- the decoded instruction at registers[PCReg]
+//----------------------------------------------------------------------
+
+template <bool trace, bool useTLB>
+bool
+Machine::DoExecute(Instruction *instr)
+{
+    int nextLoadReg = 0; 	
+    int nextLoadValue = 0; 	// record delayed load operation, to apply
+				// in the future
+
     // Compute next pc, but don't install in case there's an error or branch.
     int pcAfter = registers[NextPCReg] + 4;
     int sum, diff, tmp, value;
@@ -126,7 +291,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (!((registers[(int)instr->rs] ^ registers[(int)instr->rt]) & SIGN_BIT) &&
 	    ((registers[(int)instr->rs] ^ sum) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return FALSE;
 	}
 	registers[(int)instr->rd] = sum;
 	break;
@@ -136,7 +301,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (!((registers[(int)instr->rs] ^ instr->extra) & SIGN_BIT) &&
 	    ((instr->extra ^ sum) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return FALSE;
 	}
 	registers[(int)instr->rt] = sum;
 	break;
@@ -230,8 +395,8 @@ Machine::OneInstruction(Instruction *instr)
       case OP_LB:
       case OP_LBU:
 	tmp = registers[(int)instr->rs] + instr->extra;
-	if (!machine->ReadMem(tmp, 1, &value))
-	    return;
+	if (!DoReadMem<trace, useTLB>(tmp, 1, &value))
+	    return FALSE;
 
 	if ((value & 0x80) && (instr->opCode == OP_LB))
 	    value |= 0xffffff00;
@@ -246,10 +411,10 @@ Machine::OneInstruction(Instruction *instr)
 	tmp = registers[(int)instr->rs] + instr->extra;
 	if (tmp & 0x1) {
 	    RaiseException(AddressErrorException, tmp);
-	    return;
+	    return FALSE;
 	}
-	if (!machine->ReadMem(tmp, 2, &value))
-	    return;
+	if (!DoReadMem<trace, useTLB>(tmp, 2, &value))
+	    return FALSE;
 
 	if ((value & 0x8000) && (instr->opCode == OP_LH))
 	    value |= 0xffff0000;
@@ -260,7 +425,8 @@ Machine::OneInstruction(Instruction *instr)
 	break;
       	
       case OP_LUI:
-	DEBUG('m', "Executing: LUI r%d,%d\n", instr->rt, instr->extra);
+	if (trace)
+	    DEBUG('m', "Executing: LUI r%d,%d\n", instr->rt, instr->extra);
 	registers[(int)instr->rt] = instr->extra << 16;
 	break;
 	
@@ -268,10 +434,10 @@ Machine::OneInstruction(Instruction *instr)
 	tmp = registers[(int)instr->rs] + instr->extra;
 	if (tmp & 0x3) {
 	    RaiseException(AddressErrorException, tmp);
-	    return;
+	    return FALSE;
 	}
-	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
+	if (!DoReadMem<trace, useTLB>(tmp, 4, &value))
+	    return FALSE;
 	nextLoadReg = instr->rt;
 	nextLoadValue = value;
 	break;
@@ -284,8 +450,8 @@ Machine::OneInstruction(Instruction *instr)
         // fail (I think) if the other cases are ever exercised.
 	ASSERT((tmp & 0x3) == 0);  
 
-	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
+	if (!DoReadMem<trace, useTLB>(tmp, 4, &value))
+	    return FALSE;
 	if (registers[LoadReg] == instr->rt)
 	    nextLoadValue = registers[LoadValueReg];
 	else
@@ -315,8 +481,8 @@ Machine::OneInstruction(Instruction *instr)
         // fail (I think) if the other cases are ever exercised.
 	ASSERT((tmp & 0x3) == 0);  
 
-	if (!machine->ReadMem(tmp, 4, &value))
-	    return;
+	if (!DoReadMem<trace, useTLB>(tmp, 4, &value))
+	    return FALSE;
 	if (registers[LoadReg] == instr->rt)
 	    nextLoadValue = registers[LoadValueReg];
 	else
@@ -380,15 +546,15 @@ Machine::OneInstruction(Instruction *instr)
 	break;
 	
       case OP_SB:
-	if (!machine->WriteMem((unsigned) 
+	if (!DoWriteMem<trace, useTLB>((unsigned) 
 		(registers[(int)instr->rs] + instr->extra), 1, registers[(int)instr->rt]))
-	    return;
+	    return FALSE;
 	break;
 	
       case OP_SH:
-	if (!machine->WriteMem((unsigned) 
+	if (!DoWriteMem<trace, useTLB>((unsigned) 
 		(registers[(int)instr->rs] + instr->extra), 2, registers[(int)instr->rt]))
-	    return;
+	    return FALSE;
 	break;
 	
       case OP_SLL:
@@ -458,7 +624,7 @@ Machine::OneInstruction(Instruction *instr)
 	if (((registers[(int)instr->rs] ^ registers[(int)instr->rt]) & SIGN_BIT) &&
 	    ((registers[(int)instr->rs] ^ diff) & SIGN_BIT)) {
 	    RaiseException(OverflowException, 0);
-	    return;
+	    return FALSE;
 	}
 	registers[(int)instr->rd] = diff;
 	break;
@@ -468,9 +634,9 @@ Machine::OneInstruction(Instruction *instr)
 	break;
 	
       case OP_SW:
-	if (!machine->WriteMem((unsigned) 
+	if (!DoWriteMem<trace, useTLB>((unsigned) 
 		(registers[(int)instr->rs] + instr->extra), 4, registers[(int)instr->rt]))
-	    return;
+	    return FALSE;
 	break;
 	
       case OP_SWL:	  
@@ -480,8 +646,8 @@ Machine::OneInstruction(Instruction *instr)
         // fail (I think) if the other cases are ever exercised.
 	ASSERT((tmp & 0x3) == 0);  
 
-	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-	    return;
+	if (!DoReadMem<trace, useTLB>((tmp & ~0x3), 4, &value))
+	    return FALSE;
 	switch (tmp & 0x3) {
 	  case 0:
 	    value = registers[(int)instr->rt];
@@ -499,8 +665,8 @@ Machine::OneInstruction(Instruction *instr)
 					    0xff);
 	    break;
 	}
-	if (!machine->WriteMem((tmp & ~0x3), 4, value))
-	    return;
+	if (!DoWriteMem<trace, useTLB>((tmp & ~0x3), 4, value))
+	    return FALSE;
 	break;
     	
       case OP_SWR:	  
@@ -510,8 +676,8 @@ Machine::OneInstruction(Instruction *instr)
         // fail (I think) if the other cases are ever exercised.
 	ASSERT((tmp & 0x3) == 0);  
 
-	if (!machine->ReadMem((tmp & ~0x3), 4, &value))
-	    return;
+	if (!DoReadMem<trace, useTLB>((tmp & ~0x3), 4, &value))
+	    return FALSE;
 	switch (tmp & 0x3) {
 	  case 0:
 	    value = (value & 0xffffff) | (registers[(int)instr->rt] << 24);
@@ -526,13 +692,13 @@ Machine::OneInstruction(Instruction *instr)
 	    value = registers[(int)instr->rt];
 	    break;
 	}
-	if (!machine->WriteMem((tmp & ~0x3), 4, value))
-	    return;
+	if (!DoWriteMem<trace, useTLB>((tmp & ~0x3), 4, value))
+	    return FALSE;
 	break;
     	
       case OP_SYSCALL:
 	RaiseException(SyscallException, 0);
-	return; 
+	return FALSE;
 	
       case OP_XOR:
 	registers[(int)instr->rd] = registers[(int)instr->rs] ^ registers[(int)instr->rt];
@@ -545,7 +711,7 @@ Machine::OneInstruction(Instruction *instr)
       case OP_RES:
       case OP_UNIMP:
 	RaiseException(IllegalInstrException, 0);
-	return;
+	return FALSE;
 	
       default:
 	ASSERT(FALSE);
@@ -561,6 +727,7 @@ Machine::OneInstruction(Instruction *instr)
 						// are jumping into lala-land
     registers[PCReg] = registers[NextPCReg];
     registers[NextPCReg] = pcAfter;
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -605,6 +772,7 @@ Instruction::Decode()
     } else {
 	extra = value & 0x3ffffff;
     }
+    fused = FUSE_NONE;
     if (opCode == SPECIAL) {
 	opCode = specialTable[value & 0x3f];
     } else if (opCode == BCOND) {
@@ -624,6 +792,182 @@ Instruction::Decode()
     }
 }
 
+//----------------------------------------------------------------------
+// Machine::DoFetch
+// 	Fetch the instruction at the current PC, already decoded.
+//
+//	The PC is translated as for any other read, so page faults, 
+//	and use bits behave exactly as if we had called
+//	ReadMem.  But instead of reading and decoding the word, we return
+//	the predecoded copy of the instruction from its physical page,
+//	decoding the whole page the first time it is executed from.
+//
+//	While Verify runs the reference simulator, the translation is
+//	never in "softTLB", and we do read and decode the word, so that
+//	the engine's predecoded copy isn't checked against itself.
+//
+//	Returns NULL if the translation failed (the exception has 
+//	already been raised).  The returned instruction stays valid
+//	until the next simulated store or kernel call.
+//----------------------------------------------------------------------
+
+template <bool trace, bool useTLB>
+Instruction *
+Machine::DoFetch()
+{
+    ExceptionType exception;
+    int physicalAddress;
+    unsigned int ppn;
+
+    if (trace || !SoftTranslate(registers[PCReg], 4, FALSE, &physicalAddress)) {
+	exception = DoTranslate<trace, useTLB>(registers[PCReg],
+					       &physicalAddress, 4, FALSE);
+	if (exception != NoException) {
+	    RaiseException(exception, registers[PCReg]);
+	    return NULL;
+	}
+	if (shadowing) {
+	    shadowInstr.value = 
+		WordToHost(*(unsigned int *) &mainMemory[physicalAddress]);
+	    shadowInstr.Decode();
+	    return &shadowInstr;
+	}
+    } else if (useTLB)
+	stats->numTLBHits++;
+    ppn = (unsigned) physicalAddress / PageSize;
+    if (!pageDecoded[ppn])
+	DecodePage(ppn);
+    return &decodeCache[(unsigned) physicalAddress / 4];
+}
+
+//----------------------------------------------------------------------
+// FusionOf
+// 	Return the superinstruction (see machine.h) formed by decoded
+//	instruction "first" followed by "second", or FUSE_NONE.
+//
+//	Only the opcodes matter: a superinstruction runs its two
+//	instructions one after the other, exactly as OneInstruction
+//	would, so it is correct whatever the registers are.  We check
+//	the registers anyway for the idioms the compiler uses, so that
+//	the counts say which idioms are worth having.
+//----------------------------------------------------------------------
+
+static int
+FusionOf(Instruction *first, Instruction *second)
+{
+    switch (first->opCode) {
+      case OP_LUI:
+	if (second->rs != first->rt)
+	    return FUSE_NONE;
+	if (second->opCode == OP_ADDIU)
+	    return FUSE_LUI_ADDIU;
+	if (second->opCode == OP_ORI)
+	    return FUSE_LUI_ORI;
+	return FUSE_NONE;
+      case OP_LW:
+	return (second->value == 0) ? FUSE_LW_NOP : FUSE_NONE;
+      case OP_SLT:
+      case OP_SLTU:
+      case OP_SLTI:
+      case OP_SLTIU:
+	if (second->opCode == OP_BEQ || second->opCode == OP_BNE)
+	    return FUSE_SLT_BRANCH;
+	return FUSE_NONE;
+      case OP_BEQ:
+      case OP_BNE:
+      case OP_BLEZ:
+      case OP_BGTZ:
+      case OP_BLTZ:
+      case OP_BGEZ:
+      case OP_J:
+      case OP_JAL:
+      case OP_JR:
+	return (second->value == 0) ? FUSE_BRANCH_NOP : FUSE_NONE;
+      case OP_ADDIU:
+	if (first->rs != StackReg || first->rt != StackReg)
+	    return FUSE_NONE;
+	if (second->opCode == OP_SW)
+	    return FUSE_ADDIU_SW;
+	if (second->opCode == OP_JR)
+	    return FUSE_ADDIU_JR;
+	return FUSE_NONE;
+      default:
+	return FUSE_NONE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::DecodePage
+// 	Decode every word of physical page "ppn" into "decodeCache",
+//	and mark the superinstructions.  A superinstruction never 
+//	crosses a page boundary.
+//
+//	Data words decode to garbage instructions, but those are never
+//	fetched, so it doesn't matter.
+//----------------------------------------------------------------------
+
+void
+Machine::DecodePage(int ppn)
+{
+    Instruction *instr = &decodeCache[ppn * InstrsPerPage];
+    unsigned int *word = (unsigned int *) &mainMemory[ppn * PageSize];
+    int i;
+
+    DEBUG('m', "Predecoding physical page %d\n", ppn);
+    for (i = 0; i < InstrsPerPage; i++, word++) {
+	instr[i].value = WordToHost(*word);
+	instr[i].Decode();
+    }
+    for (i = 0; i < InstrsPerPage - 1; i++)
+	instr[i].fused = FusionOf(&instr[i], &instr[i + 1]);
+    pageDecoded[ppn] = TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::RedecodeWord
+// 	A user store just modified the word containing "physAddr".  If
+//	its page has been predecoded, decode the new contents, so that
+//	self-modifying code (and data sharing a page with code) keeps
+//	working.
+//----------------------------------------------------------------------
+
+void
+Machine::RedecodeWord(int physAddr)
+{
+    unsigned int index = (unsigned) physAddr / 4;
+
+    if (!pageDecoded[index / InstrsPerPage])
+	return;
+    decodeCache[index].value =
+	WordToHost(*(unsigned int *) &mainMemory[index * 4]);
+    decodeCache[index].Decode();
+
+    // the word may now start or end a different superinstruction
+    if ((index + 1) % InstrsPerPage != 0)
+	decodeCache[index].fused = 
+	    FusionOf(&decodeCache[index], &decodeCache[index + 1]);
+    if (index % InstrsPerPage != 0)
+	decodeCache[index - 1].fused =
+	    FusionOf(&decodeCache[index - 1], &decodeCache[index]);
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateCode
+// 	Throw away the predecoded copy of physical page "ppn", and any
+//	blocks translated from it.  The kernel calls this whenever it
+//	changes the contents of a frame behind the simulated CPU's 
+//	back, eg, when loading a program, or when it frees the frame.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateCode(int ppn)
+{
+    ASSERT((ppn >= 0) && (ppn < numPhysPages));
+    pageDecoded[ppn] = FALSE;
+    if (blockCache != NULL)
+	blockCache->InvalidateFrame(ppn);
+}
+
 //----------------------------------------------------------------------
 // Mult
 // 	Simulate R2000 multiplication.
@@ -631,7 +975,7 @@ Instruction::Decode()
 // 	double-length result of the multiplication.
 //----------------------------------------------------------------------
 
-static void
+void
 Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr)
 {
     if ((a == 0) || (b == 0)) {
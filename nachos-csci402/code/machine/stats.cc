@@ -23,6 +23,9 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numEvictions = numSwapReads = numSwapWrites = numSwapTransfers = 0;
+    numReadAheads = numReadAheadsUnused = 0;
+    numTLBHits = numTLBMisses = numTLBEvictions = 0;
 }
 
 //----------------------------------------------------------------------
@@ -40,7 +43,16 @@ Statistics::Print()
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
-    printf("Paging: faults %d\n", numPageFaults);
+    printf("Paging: faults %d, evictions %d\n", numPageFaults, numEvictions);
+    if (numReadAheads > 0)
+	printf("Read-ahead: pages %d, unused %d\n", numReadAheads,
+	       numReadAheadsUnused);
+    if (numSwapReads > 0 || numSwapWrites > 0)
+	printf("Swap I/O: reads %d, writes %d (in %d transfers)\n",
+	       numSwapReads, numSwapWrites, numSwapTransfers);
+    if (numTLBHits > 0 || numTLBMisses > 0)
+	printf("TLB: hits %d, misses %d, evictions %d\n", numTLBHits,
+	       numTLBMisses, numTLBEvictions);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
 }
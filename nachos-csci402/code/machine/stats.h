@@ -33,6 +33,19 @@ class Statistics {
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numEvictions;		// number of pages evicted from memory
+    int numReadAheads;		// number of pages read ahead of faults
+    int numReadAheadsUnused;	// ... and evicted without being used
+    int numSwapReads;		// number of pages read from swap
+    int numSwapWrites;		// number of pages written to swap
+    int numSwapTransfers;	// number of writes to swap, of one page
+				// or more
+    int numTLBHits;		// number of translations found in the TLB
+				// (exact with -cpu reference; the faster
+				// engines look up code less often)
+    int numTLBMisses;		// number of TLB misses (page fault 
+				// exceptions, when there is a TLB)
+    int numTLBEvictions;	// number of valid TLB entries replaced
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
 
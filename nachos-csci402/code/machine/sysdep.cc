@@ -38,6 +38,10 @@
 #include <sys/socket.h>
 #include <sys/mman.h>
 
+#ifndef MAP_ANONYMOUS		// Solaris only calls it MAP_ANON
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
 #include "interrupt.h"
 #include "system.h"
 
@@ -440,3 +444,43 @@ DeallocBoundedArray(char *ptr, int size)
     mprotect(ptr + size, pgSize, PROT_READ | PROT_WRITE | PROT_EXEC);
     delete [] (ptr - pgSize);
 }
+
+//----------------------------------------------------------------------
+// AllocZeroedMemory
+// 	Return a zero-filled array, mapped straight from the host's
+//	virtual memory, so that the host only provides (and zeroes) each
+//	page of it when it is first touched.  A large array thus costs 
+//	nothing until it is used.
+//
+//	"size" -- the size of the array (in bytes)
+//	"hugePages" -- ask the host to back the array with huge pages
+//		where it can, to save host TLB misses; just a hint
+//----------------------------------------------------------------------
+
+char *
+AllocZeroedMemory(int size, bool hugePages)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    ASSERT(ptr != MAP_FAILED);
+#ifdef MADV_HUGEPAGE
+    if (hugePages)
+	(void) madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    return (char *) ptr;
+}
+
+//----------------------------------------------------------------------
+// FreeZeroedMemory
+// 	De-allocate an array returned by AllocZeroedMemory.
+//
+//	"ptr" -- the array to be deallocated
+//	"size" -- its size (in bytes)
+//----------------------------------------------------------------------
+
+void
+FreeZeroedMemory(char *ptr, int size)
+{
+    munmap(ptr, size);
+}
@@ -55,6 +55,11 @@ extern int Random();
 extern char *AllocBoundedArray(int size);
 extern void DeallocBoundedArray(char *p, int size);
 
+// Allocate, de-allocate a large zero-filled array, without touching it:
+// the host fills in its pages only as they are used
+extern char *AllocZeroedMemory(int size, bool hugePages);
+extern void FreeZeroedMemory(char *p, int size);
+
 #include <stdio.h>		// for printf, fprintf
 #include <string.h>		// for DEBUG, etc.
 #include <stdlib.h>
@@ -0,0 +1,684 @@
+// threaded.cc
+//	A faster engine for simulating user programs: direct-threaded
+//	dispatch over predecoded instructions.
+//
+//	The reference engine (Machine::OneInstruction in mipssim.cc)
+//	returns to Machine::Run after every instruction, and picks the
+//	operation with a bounds-checked switch.  Here we never leave
+//	the loop: each opcode is a label, the address of every label is
+//	kept in a table indexed by the decoded opcode, and each handler
+//	ends by retiring its instruction, advancing time, fetching the
+//	next predecoded instruction and jumping straight to its handler.
+//	Giving every handler its own copy of the dispatch lets the host
+//	predict the next jump from the current opcode.
+//
+//	This uses the "labels as values" extension of g++.
+//
+//	Every handler does exactly what the corresponding case in
+//	OneInstruction does (including its quirks, such as OR using
+//	"rs" twice and SRL being arithmetic), so that the two engines
+//	can never be told apart by a user program.
+
+#include "copyright.h"
+
+#include "machine.h"
+#include "mipssim.h"
+#include "system.h"
+
+// Shorthands for the handlers below
+#define RS	registers[(int)instr->rs]
+#define RT	registers[(int)instr->rt]
+#define RD	registers[(int)instr->rd]
+#define IMM	(instr->extra)
+
+// Fetch the next instruction and jump to its handler.  If the fetch
+// raised an exception, time still advances before we try again, just
+// as in Machine::Run.  An instruction that starts a superinstruction
+// goes to the handler for the pair instead, unless it is in a delay
+// slot (in which case its partner isn't the next instruction).
+#define NEXT()								\
+    {									\
+	instr = FetchInstruction();					\
+	if (instr == NULL)						\
+	    goto tick;							\
+	nextLoadReg = 0;						\
+	nextLoadValue = 0;						\
+	pcAfter = registers[NextPCReg] + 4;				\
+	if (instr->fused != FUSE_NONE && pcAfter == registers[PCReg] + 8) \
+	    goto *fusedHandlers[(int)instr->fused];			\
+	goto *handlers[(int)instr->opCode];				\
+    }
+
+// Finish the current instruction: do any delayed load and advance the
+// program counters.
+#define RETIRE()							\
+    {									\
+	registers[registers[LoadReg]] = registers[LoadValueReg];	\
+	registers[LoadReg] = nextLoadReg;				\
+	registers[LoadValueReg] = nextLoadValue;			\
+	registers[0] = 0;						\
+	registers[PrevPCReg] = registers[PCReg];			\
+	registers[PCReg] = registers[NextPCReg];			\
+	registers[NextPCReg] = pcAfter;					\
+    }
+
+// Retire the current instruction, advance simulated time, then go on
+// to the next one.
+#define DISPATCH()							\
+    {									\
+	RETIRE();							\
+	Tick();								\
+	NEXT();								\
+    }
+
+// In a superinstruction, advance simulated time after the first
+// instruction and go on to the second, which is already decoded and
+// in the same page, without fetching it -- unless the kernel got
+// control, in which case it might have changed anything, so we fetch
+// the next instruction the usual way.
+#define SECOND()							\
+    {									\
+	if (Tick())							\
+	    NEXT();							\
+	instr++;							\
+	nextLoadReg = 0;						\
+	nextLoadValue = 0;						\
+	pcAfter = registers[NextPCReg] + 4;				\
+    }
+
+// Give up on the current instruction -- an exception has been raised,
+// and the kernel has already dealt with it.
+#define ABORT()		goto tick
+
+//----------------------------------------------------------------------
+// Machine::RunThreaded
+// 	Simulate the execution of a user-level program, using the
+//	threaded engine.  Called by Machine::Run; never returns.
+//
+//	Like OneInstruction, we cache nothing across instructions but
+//	the predecoded code itself, so the kernel is free to change the
+//	registers, memory or translation tables on any exception or
+//	interrupt.
+//----------------------------------------------------------------------
+
+void
+Machine::RunThreaded()
+{
+    void *handlers[MaxOpcode + 1];
+    void *fusedHandlers[NumFusions];
+    Instruction *instr;
+    int nextLoadReg, nextLoadValue, pcAfter;
+    int sum, diff, tmp, value;
+    unsigned int rs, rt, imm;
+    int i;
+
+    for (i = 0; i <= MaxOpcode; i++)
+	handlers[i] = &&op_unknown;
+    handlers[OP_ADD] = &&op_add;	handlers[OP_ADDI] = &&op_addi;
+    handlers[OP_ADDIU] = &&op_addiu;	handlers[OP_ADDU] = &&op_addu;
+    handlers[OP_AND] = &&op_and;	handlers[OP_ANDI] = &&op_andi;
+    handlers[OP_BEQ] = &&op_beq;	handlers[OP_BGEZ] = &&op_bgez;
+    handlers[OP_BGEZAL] = &&op_bgezal;	handlers[OP_BGTZ] = &&op_bgtz;
+    handlers[OP_BLEZ] = &&op_blez;	handlers[OP_BLTZ] = &&op_bltz;
+    handlers[OP_BLTZAL] = &&op_bltzal;	handlers[OP_BNE] = &&op_bne;
+    handlers[OP_DIV] = &&op_div;	handlers[OP_DIVU] = &&op_divu;
+    handlers[OP_J] = &&op_j;		handlers[OP_JAL] = &&op_jal;
+    handlers[OP_JALR] = &&op_jalr;	handlers[OP_JR] = &&op_jr;
+    handlers[OP_LB] = &&op_lb;		handlers[OP_LBU] = &&op_lb;
+    handlers[OP_LH] = &&op_lh;		handlers[OP_LHU] = &&op_lh;
+    handlers[OP_LUI] = &&op_lui;	handlers[OP_LW] = &&op_lw;
+    handlers[OP_LWL] = &&op_lwl;	handlers[OP_LWR] = &&op_lwr;
+    handlers[OP_MFHI] = &&op_mfhi;	handlers[OP_MFLO] = &&op_mflo;
+    handlers[OP_MTHI] = &&op_mthi;	handlers[OP_MTLO] = &&op_mtlo;
+    handlers[OP_MULT] = &&op_mult;	handlers[OP_MULTU] = &&op_multu;
+    handlers[OP_NOR] = &&op_nor;	handlers[OP_OR] = &&op_or;
+    handlers[OP_ORI] = &&op_ori;	handlers[OP_SB] = &&op_sb;
+    handlers[OP_SH] = &&op_sh;		handlers[OP_SLL] = &&op_sll;
+    handlers[OP_SLLV] = &&op_sllv;	handlers[OP_SLT] = &&op_slt;
+    handlers[OP_SLTI] = &&op_slti;	handlers[OP_SLTIU] = &&op_sltiu;
+    handlers[OP_SLTU] = &&op_sltu;	handlers[OP_SRA] = &&op_sra;
+    handlers[OP_SRAV] = &&op_srav;	handlers[OP_SRL] = &&op_srl;
+    handlers[OP_SRLV] = &&op_srlv;	handlers[OP_SUB] = &&op_sub;
+    handlers[OP_SUBU] = &&op_subu;	handlers[OP_SW] = &&op_sw;
+    handlers[OP_SWL] = &&op_swl;	handlers[OP_SWR] = &&op_swr;
+    handlers[OP_SYSCALL] = &&op_syscall; handlers[OP_XOR] = &&op_xor;
+    handlers[OP_XORI] = &&op_xori;	handlers[OP_RES] = &&op_illegal;
+    handlers[OP_UNIMP] = &&op_illegal;
+
+    fusedHandlers[FUSE_NONE] = &&op_unknown;
+    fusedHandlers[FUSE_LUI_ADDIU] = &&fuse_lui_addiu;
+    fusedHandlers[FUSE_LUI_ORI] = &&fuse_lui_ori;
+    fusedHandlers[FUSE_LW_NOP] = &&fuse_lw_nop;
+    fusedHandlers[FUSE_SLT_BRANCH] = &&fuse_slt_branch;
+    fusedHandlers[FUSE_BRANCH_NOP] = &&fuse_branch_nop;
+    fusedHandlers[FUSE_ADDIU_SW] = &&fuse_addiu_sw;
+    fusedHandlers[FUSE_ADDIU_JR] = &&fuse_addiu_jr;
+
+    NEXT();
+
+  tick:
+    Tick();
+    NEXT();
+
+  op_add:
+    sum = RS + RT;
+    if (!((RS ^ RT) & SIGN_BIT) && ((RS ^ sum) & SIGN_BIT)) {
+	RaiseException(OverflowException, 0);
+	ABORT();
+    }
+    RD = sum;
+    DISPATCH();
+
+  op_addi:
+    sum = RS + IMM;
+    if (!((RS ^ IMM) & SIGN_BIT) && ((IMM ^ sum) & SIGN_BIT)) {
+	RaiseException(OverflowException, 0);
+	ABORT();
+    }
+    RT = sum;
+    DISPATCH();
+
+  op_addiu:
+    RT = RS + IMM;
+    DISPATCH();
+
+  op_addu:
+    RD = RS + RT;
+    DISPATCH();
+
+  op_and:
+    RD = RS & RT;
+    DISPATCH();
+
+  op_andi:
+    RT = RS & (IMM & 0xffff);
+    DISPATCH();
+
+  op_beq:
+    if (RS == RT)
+	pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+    DISPATCH();
+
+  op_bgezal:
+    registers[R31] = registers[NextPCReg] + 4;
+  op_bgez:
+    if (!(RS & SIGN_BIT))
+	pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+    DISPATCH();
+
+  op_bgtz:
+    if (RS > 0)
+	pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+    DISPATCH();
+
+  op_blez:
+    if (RS <= 0)
+	pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+    DISPATCH();
+
+  op_bltzal:
+    registers[R31] = registers[NextPCReg] + 4;
+  op_bltz:
+    if (RS & SIGN_BIT)
+	pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+    DISPATCH();
+
+  op_bne:
+    if (RS != RT)
+	pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+    DISPATCH();
+
+  op_div:
+    if (RT == 0) {
+	registers[LoReg] = 0;
+	registers[HiReg] = 0;
+    } else {
+	registers[LoReg] = RS / RT;
+	registers[HiReg] = RS % RT;
+    }
+    DISPATCH();
+
+  op_divu:
+    rs = (unsigned int) RS;
+    rt = (unsigned int) RT;
+    if (rt == 0) {
+	registers[LoReg] = 0;
+	registers[HiReg] = 0;
+    } else {
+	tmp = rs / rt;
+	registers[LoReg] = (int) tmp;
+	tmp = rs % rt;
+	registers[HiReg] = (int) tmp;
+    }
+    DISPATCH();
+
+  op_jal:
+    registers[R31] = registers[NextPCReg] + 4;
+  op_j:
+    pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(IMM);
+    DISPATCH();
+
+  op_jalr:
+    RD = registers[NextPCReg] + 4;
+  op_jr:
+    pcAfter = RS;
+    DISPATCH();
+
+  op_lb:				// also LBU
+    tmp = RS + IMM;
+    if (!ReadMem(tmp, 1, &value))
+	ABORT();
+    if ((value & 0x80) && (instr->opCode == OP_LB))
+	value |= 0xffffff00;
+    else
+	value &= 0xff;
+    nextLoadReg = instr->rt;
+    nextLoadValue = value;
+    DISPATCH();
+
+  op_lh:				// also LHU
+    tmp = RS + IMM;
+    if (tmp & 0x1) {
+	RaiseException(AddressErrorException, tmp);
+	ABORT();
+    }
+    if (!ReadMem(tmp, 2, &value))
+	ABORT();
+    if ((value & 0x8000) && (instr->opCode == OP_LH))
+	value |= 0xffff0000;
+    else
+	value &= 0xffff;
+    nextLoadReg = instr->rt;
+    nextLoadValue = value;
+    DISPATCH();
+
+  op_lui:
+    RT = IMM << 16;
+    DISPATCH();
+
+  op_lw:
+    tmp = RS + IMM;
+    if (tmp & 0x3) {
+	RaiseException(AddressErrorException, tmp);
+	ABORT();
+    }
+    if (!ReadMem(tmp, 4, &value))
+	ABORT();
+    nextLoadReg = instr->rt;
+    nextLoadValue = value;
+    DISPATCH();
+
+  op_lwl:
+    tmp = RS + IMM;
+    ASSERT((tmp & 0x3) == 0);		// see OneInstruction
+    if (!ReadMem(tmp, 4, &value))
+	ABORT();
+    if (registers[LoadReg] == instr->rt)
+	nextLoadValue = registers[LoadValueReg];
+    else
+	nextLoadValue = RT;
+    switch (tmp & 0x3) {
+      case 0:
+	nextLoadValue = value;
+	break;
+      case 1:
+	nextLoadValue = (nextLoadValue & 0xff) | (value << 8);
+	break;
+      case 2:
+	nextLoadValue = (nextLoadValue & 0xffff) | (value << 16);
+	break;
+      case 3:
+	nextLoadValue = (nextLoadValue & 0xffffff) | (value << 24);
+	break;
+    }
+    nextLoadReg = instr->rt;
+    DISPATCH();
+
+  op_lwr:
+    tmp = RS + IMM;
+    ASSERT((tmp & 0x3) == 0);		// see OneInstruction
+    if (!ReadMem(tmp, 4, &value))
+	ABORT();
+    if (registers[LoadReg] == instr->rt)
+	nextLoadValue = registers[LoadValueReg];
+    else
+	nextLoadValue = RT;
+    switch (tmp & 0x3) {
+      case 0:
+	nextLoadValue = (nextLoadValue & 0xffffff00) |
+	    ((value >> 24) & 0xff);
+	break;
+      case 1:
+	nextLoadValue = (nextLoadValue & 0xffff0000) |
+	    ((value >> 16) & 0xffff);
+	break;
+      case 2:
+	nextLoadValue = (nextLoadValue & 0xff000000)
+	    | ((value >> 8) & 0xffffff);
+	break;
+      case 3:
+	nextLoadValue = value;
+	break;
+    }
+    nextLoadReg = instr->rt;
+    DISPATCH();
+
+  op_mfhi:
+    RD = registers[HiReg];
+    DISPATCH();
+
+  op_mflo:
+    RD = registers[LoReg];
+    DISPATCH();
+
+  op_mthi:
+    registers[HiReg] = RS;
+    DISPATCH();
+
+  op_mtlo:
+    registers[LoReg] = RS;
+    DISPATCH();
+
+  op_mult:
+    Mult(RS, RT, TRUE, &registers[HiReg], &registers[LoReg]);
+    DISPATCH();
+
+  op_multu:
+    Mult(RS, RT, FALSE, &registers[HiReg], &registers[LoReg]);
+    DISPATCH();
+
+  op_nor:
+    RD = ~(RS | RT);
+    DISPATCH();
+
+  op_or:
+    RD = RS | RS;			// sic -- same as OneInstruction
+    DISPATCH();
+
+  op_ori:
+    RT = RS | (IMM & 0xffff);
+    DISPATCH();
+
+  op_sb:
+    if (!WriteMem((unsigned) (RS + IMM), 1, RT))
+	ABORT();
+    DISPATCH();
+
+  op_sh:
+    if (!WriteMem((unsigned) (RS + IMM), 2, RT))
+	ABORT();
+    DISPATCH();
+
+  op_sll:
+    RD = RT << IMM;
+    DISPATCH();
+
+  op_sllv:
+    RD = RT << (RS & 0x1f);
+    DISPATCH();
+
+  op_slt:
+    RD = (RS < RT) ? 1 : 0;
+    DISPATCH();
+
+  op_slti:
+    RT = (RS < IMM) ? 1 : 0;
+    DISPATCH();
+
+  op_sltiu:
+    rs = RS;
+    imm = IMM;
+    RT = (rs < imm) ? 1 : 0;
+    DISPATCH();
+
+  op_sltu:
+    rs = RS;
+    rt = RT;
+    RD = (rs < rt) ? 1 : 0;
+    DISPATCH();
+
+  op_sra:
+    RD = RT >> IMM;
+    DISPATCH();
+
+  op_srav:
+    RD = RT >> (RS & 0x1f);
+    DISPATCH();
+
+  op_srl:
+    tmp = RT;
+    tmp >>= IMM;
+    RD = tmp;
+    DISPATCH();
+
+  op_srlv:
+    tmp = RT;
+    tmp >>= (RS & 0x1f);
+    RD = tmp;
+    DISPATCH();
+
+  op_sub:
+    diff = RS - RT;
+    if (((RS ^ RT) & SIGN_BIT) && ((RS ^ diff) & SIGN_BIT)) {
+	RaiseException(OverflowException, 0);
+	ABORT();
+    }
+    RD = diff;
+    DISPATCH();
+
+  op_subu:
+    RD = RS - RT;
+    DISPATCH();
+
+  op_sw:
+    if (!WriteMem((unsigned) (RS + IMM), 4, RT))
+	ABORT();
+    DISPATCH();
+
+  op_swl:
+    tmp = RS + IMM;
+    ASSERT((tmp & 0x3) == 0);		// see OneInstruction
+    if (!ReadMem((tmp & ~0x3), 4, &value))
+	ABORT();
+    switch (tmp & 0x3) {
+      case 0:
+	value = RT;
+	break;
+      case 1:
+	value = (value & 0xff000000) | ((RT >> 8) & 0xffffff);
+	break;
+      case 2:
+	value = (value & 0xffff0000) | ((RT >> 16) & 0xffff);
+	break;
+      case 3:
+	value = (value & 0xffffff00) | ((RT >> 24) & 0xff);
+	break;
+    }
+    if (!WriteMem((tmp & ~0x3), 4, value))
+	ABORT();
+    DISPATCH();
+
+  op_swr:
+    tmp = RS + IMM;
+    ASSERT((tmp & 0x3) == 0);		// see OneInstruction
+    if (!ReadMem((tmp & ~0x3), 4, &value))
+	ABORT();
+    switch (tmp & 0x3) {
+      case 0:
+	value = (value & 0xffffff) | (RT << 24);
+	break;
+      case 1:
+	value = (value & 0xffff) | (RT << 16);
+	break;
+      case 2:
+	value = (value & 0xff) | (RT << 8);
+	break;
+      case 3:
+	value = RT;
+	break;
+    }
+    if (!WriteMem((tmp & ~0x3), 4, value))
+	ABORT();
+    DISPATCH();
+
+  op_syscall:
+    RaiseException(SyscallException, 0);
+    ABORT();
+
+  op_xor:
+    RD = RS ^ RT;
+    DISPATCH();
+
+  op_xori:
+    RT = RS ^ (IMM & 0xffff);
+    DISPATCH();
+
+  op_illegal:
+    RaiseException(IllegalInstrException, 0);
+    ABORT();
+
+  op_unknown:
+    ASSERT(FALSE);
+    ABORT();
+
+// Superinstructions.  Each runs the handlers of its two instructions
+// back to back, with SECOND in between.
+
+  fuse_lui_addiu:
+    fusionCount[FUSE_LUI_ADDIU]++;
+    RT = IMM << 16;
+    RETIRE();
+    SECOND();
+    RT = RS + IMM;
+    DISPATCH();
+
+  fuse_lui_ori:
+    fusionCount[FUSE_LUI_ORI]++;
+    RT = IMM << 16;
+    RETIRE();
+    SECOND();
+    RT = RS | (IMM & 0xffff);
+    DISPATCH();
+
+  fuse_lw_nop:
+    fusionCount[FUSE_LW_NOP]++;
+    tmp = RS + IMM;
+    if (tmp & 0x3) {
+	RaiseException(AddressErrorException, tmp);
+	ABORT();
+    }
+    if (!ReadMem(tmp, 4, &value))
+	ABORT();
+    nextLoadReg = instr->rt;
+    nextLoadValue = value;
+    RETIRE();
+    SECOND();
+    DISPATCH();				// the nop does nothing
+
+  fuse_slt_branch:
+    fusionCount[FUSE_SLT_BRANCH]++;
+    switch (instr->opCode) {
+      case OP_SLT:
+	RD = (RS < RT) ? 1 : 0;
+	break;
+      case OP_SLTU:
+	rs = RS;
+	rt = RT;
+	RD = (rs < rt) ? 1 : 0;
+	break;
+      case OP_SLTI:
+	RT = (RS < IMM) ? 1 : 0;
+	break;
+      case OP_SLTIU:
+	rs = RS;
+	imm = IMM;
+	RT = (rs < imm) ? 1 : 0;
+	break;
+    }
+    RETIRE();
+    SECOND();
+    if ((instr->opCode == OP_BEQ) ? (RS == RT) : (RS != RT))
+	pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+    if (instr->fused == FUSE_BRANCH_NOP) {	// and an empty delay slot
+	RETIRE();
+	SECOND();
+    }
+    DISPATCH();
+
+  fuse_branch_nop:
+    fusionCount[FUSE_BRANCH_NOP]++;
+    switch (instr->opCode) {
+      case OP_BEQ:
+	if (RS == RT)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+	break;
+      case OP_BNE:
+	if (RS != RT)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+	break;
+      case OP_BLEZ:
+	if (RS <= 0)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+	break;
+      case OP_BGTZ:
+	if (RS > 0)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+	break;
+      case OP_BLTZ:
+	if (RS & SIGN_BIT)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+	break;
+      case OP_BGEZ:
+	if (!(RS & SIGN_BIT))
+	    pcAfter = registers[NextPCReg] + IndexToAddr(IMM);
+	break;
+      case OP_JAL:
+	registers[R31] = registers[NextPCReg] + 4;
+      case OP_J:
+	pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(IMM);
+	break;
+      case OP_JR:
+	pcAfter = RS;
+	break;
+    }
+    RETIRE();
+    SECOND();
+    DISPATCH();				// the delay slot does nothing
+
+  fuse_addiu_sw:
+    fusionCount[FUSE_ADDIU_SW]++;
+    RT = RS + IMM;
+    RETIRE();
+    SECOND();
+    if (!WriteMem((unsigned) (RS + IMM), 4, RT))
+	ABORT();
+    DISPATCH();
+
+  fuse_addiu_jr:
+    fusionCount[FUSE_ADDIU_JR]++;
+    RT = RS + IMM;
+    RETIRE();
+    SECOND();
+    pcAfter = RS;
+    DISPATCH();
+}
+
+//----------------------------------------------------------------------
+// Machine::PrintFusions
+// 	Report how often each superinstruction was run, to help decide
+//	which ones are worth having.  Printed on exit with the 'e' debug
+//	flag, when the threaded engine is in use.
+//----------------------------------------------------------------------
+
+static const char *fusionNames[NumFusions] = { NULL,
+    "lui+addiu", "lui+ori", "lw+nop", "slt+branch", "branch+nop",
+    "addiu sp+sw", "addiu sp+jr" };
+
+void
+Machine::PrintFusions()
+{
+    printf("Superinstructions:");
+    for (int i = FUSE_NONE + 1; i < NumFusions; i++)
+	printf(" %s %d", fusionNames[i], fusionCount[i]);
+    printf("\n");
+}
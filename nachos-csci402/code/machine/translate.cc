@@ -31,6 +31,7 @@
 
 #include "copyright.h"
 #include "machine.h"
+#include "blockcache.h"
 #include "addrspace.h"
 #include "system.h"
 
@@ -82,23 +83,35 @@ ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
 //	"addr" -- the virtual address to read from
 //	"size" -- the number of bytes to read (1, 2, or 4)
 //	"value" -- the place to write the result
+//
+//	Unless we are tracing, a page that has been translated recently 
+//	is found in "softTLB", without calling Translate.
+//
+//	This is instantiated for each combination of "trace" (is 
+//	debugging output wanted?) and "useTLB" (see DoTranslate);
+//	Machine::ReadMem calls the one picked by Specialize.
 //----------------------------------------------------------------------
 
+template <bool trace, bool useTLB>
 bool
-Machine::ReadMem(int addr, int size, int *value)
+Machine::DoReadMem(int addr, int size, int *value)
 {
     int data;
     ExceptionType exception;
     int physicalAddress;
-    unsigned int ppn;
     
-    DEBUG('a', "Reading VA 0x%x, size %d\n", addr, size);
+    if (trace)
+	DEBUG('a', "Reading VA 0x%x, size %d\n", addr, size);
     
-    exception = Translate(addr, &physicalAddress, size, FALSE);
-    if (exception != NoException) {
-	machine->RaiseException(exception, addr);
-	return FALSE;
-    }
+    if (trace || !SoftTranslate(addr, size, FALSE, &physicalAddress)) {
+	exception = DoTranslate<trace, useTLB>(addr, &physicalAddress, size,
+					       FALSE);
+	if (exception != NoException) {
+	    machine->RaiseException(exception, addr);
+	    return FALSE;
+	}
+    } else if (useTLB)
+	stats->numTLBHits++;
     switch (size) {
       case 1:
 	data = machine->mainMemory[physicalAddress];
@@ -118,11 +131,8 @@ Machine::ReadMem(int addr, int size, int *value)
       default: ASSERT(FALSE);
     }
     
-    //Update the time value only if we succeed
-    ppn = (unsigned) physicalAddress/ PageSize;
-    machine->lastUsed[ppn] = stats->totalTicks;
-    
-    DEBUG('a', "\tvalue read = %8.8x\n", *value);
+    if (trace)
+	DEBUG('a', "\tvalue read = %8.8x\n", *value);
     return (TRUE);
 }
 
@@ -137,22 +147,29 @@ Machine::ReadMem(int addr, int size, int *value)
 //	"addr" -- the virtual address to write to
 //	"size" -- the number of bytes to be written (1, 2, or 4)
 //	"value" -- the data to be written
+//
+//	Instantiated in the same way as DoReadMem.
 //----------------------------------------------------------------------
 
+template <bool trace, bool useTLB>
 bool
-Machine::WriteMem(int addr, int size, int value)
+Machine::DoWriteMem(int addr, int size, int value)
 {
     ExceptionType exception;
     int physicalAddress;
-    unsigned int ppn; 
      
-    DEBUG('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
+    if (trace)
+	DEBUG('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
 
-    exception = Translate(addr, &physicalAddress, size, TRUE);
-    if (exception != NoException) {
-	machine->RaiseException(exception, addr);
-	return FALSE;
-    }
+    if (trace || !SoftTranslate(addr, size, TRUE, &physicalAddress)) {
+	exception = DoTranslate<trace, useTLB>(addr, &physicalAddress, size,
+					       TRUE);
+	if (exception != NoException) {
+	    machine->RaiseException(exception, addr);
+	    return FALSE;
+	}
+    } else if (useTLB)
+	stats->numTLBHits++;
     switch (size) {
       case 1:
 	machine->mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
@@ -170,16 +187,220 @@ Machine::WriteMem(int addr, int size, int value)
 	
       default: ASSERT(FALSE);
     }
+    RedecodeWord(physicalAddress);	// in case we just wrote code
+    if (blockCache != NULL && blockCache->IsCode(physicalAddress))
+	blockCache->InvalidateFrame(physicalAddress / PageSize);
    
-    //Update the time value only if we succeed
-    ppn = (unsigned) physicalAddress/ PageSize;
-    machine->lastUsed[ppn] = stats->totalTicks;
-    
     return TRUE;
 }
 
 //----------------------------------------------------------------------
-// Machine::Translate
+// Machine::TryReadMem
+// 	Like ReadMem, for code compiled by the JIT engine: if the access
+//	can't be done, return FALSE without raising an exception.  The
+//	compiled code then stops, and the interpreter executes the 
+//	instruction again, raising the exception in the usual way.
+//----------------------------------------------------------------------
+
+bool
+Machine::TryReadMem(int addr, int size, int *value)
+{
+    int physicalAddress;
+
+    if (Translate(addr, &physicalAddress, size, FALSE) != NoException)
+	return FALSE;
+    switch (size) {
+      case 1:
+	*value = (unsigned char) mainMemory[physicalAddress];
+	break;
+      case 4:
+	*value = WordToHost(*(unsigned int *) &mainMemory[physicalAddress]);
+	break;
+      default: ASSERT(FALSE);
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::TryWriteMem
+// 	Like WriteMem, for code compiled by the JIT engine; see 
+//	TryReadMem.  A store into translated code also fails, so that
+//	compiled code never has to cope with overwriting itself.
+//----------------------------------------------------------------------
+
+bool
+Machine::TryWriteMem(int addr, int size, int value)
+{
+    int physicalAddress;
+
+    if (Translate(addr, &physicalAddress, size, TRUE) != NoException
+	    || blockCache->IsCode(physicalAddress))
+	return FALSE;
+    switch (size) {
+      case 1:
+	mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
+	break;
+      case 4:
+	*(unsigned int *) &mainMemory[physicalAddress]
+		= WordToMachine((unsigned int) value);
+	break;
+      default: ASSERT(FALSE);
+    }
+    RedecodeWord(physicalAddress);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyPages
+// 	Copy "len" bytes between virtual memory at "virtAddr" and the
+//	kernel buffer "buf", for a system call.  Each page is translated
+//	once, and copied with a single memcpy.
+//
+//	If a page isn't in memory (or, with a TLB, isn't in the TLB), or
+//	is read-only, we raise the exception, so that the kernel can fix
+//	that, and try the page again.  If it fails again, or the address
+//	isn't in the address space at all, we give up.
+//
+//	Returns "len", or -1 if the copy failed (perhaps part way).
+//
+//	"writing" -- TRUE to copy "buf" into virtual memory (CopyOut),
+//		FALSE to copy virtual memory into "buf" (CopyIn)
+//----------------------------------------------------------------------
+
+int
+Machine::CopyPages(int virtAddr, int len, char *buf, bool writing)
+{
+    ExceptionType exception;
+    int physAddr, done, chunk;
+    bool retried = FALSE;
+
+    if (len < 0)
+	return -1;
+    for (done = 0; done < len; done += chunk) {
+	exception = Translate(virtAddr + done, &physAddr, 1, writing);
+	if (exception != NoException) {
+	    if (retried || (exception != PageFaultException
+			    && exception != ReadOnlyException))
+		return -1;
+	    RaiseException(exception, virtAddr + done);
+	    retried = TRUE;
+	    chunk = 0;
+	    continue;
+	}
+	retried = FALSE;
+	chunk = min(PageSize - physAddr % PageSize, len - done);
+	if (writing) {
+	    memcpy(&mainMemory[physAddr], &buf[done], chunk);
+	    InvalidateCode(physAddr / PageSize);	// in case it was code
+	} else
+	    memcpy(&buf[done], &mainMemory[physAddr], chunk);
+    }
+    return len;
+}
+
+//----------------------------------------------------------------------
+// Machine::ConfigureTLB
+// 	Replace the TLB with an empty one.  Called when the machine is
+//	built, and by the kernel (before running anything) to change the
+//	size, associativity or replacement policy.
+//
+//	"size" -- the number of entries
+//	"ways" -- the number of entries in each set; must divide "size".
+//		At least two, since one instruction can need two pages
+//		(its code and its data) -- with one, they could keep
+//		evicting each other, and the instruction would never run
+//	"policy" -- how TLBVictim chooses the entry to replace
+//----------------------------------------------------------------------
+
+void
+Machine::ConfigureTLB(int size, int ways, TLBPolicy policy)
+{
+    int i;
+
+    ASSERT(ways >= 2 && size % ways == 0);
+    if (tlb != NULL) {
+	delete [] tlb;
+	delete [] tlbHand;
+	delete [] tlbReferenced;
+    }
+    tlbSize = size;
+    tlbWays = ways;
+    tlbPolicy = policy;
+    tlb = new TranslationEntry[size];
+    tlbHand = new int[size / ways];
+    tlbReferenced = new bool[size];
+    for (i = 0; i < size; i++) {
+	tlb[i].valid = FALSE;
+	tlbReferenced[i] = FALSE;
+    }
+    for (i = 0; i < size / ways; i++)
+	tlbHand[i] = 0;
+    FlushTranslations();
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBVictim
+// 	Choose the TLB entry to load a translation for "vpn" into, on a
+//	TLB miss: an empty entry in its set if there is one, otherwise
+//	one picked by the replacement policy.  The kernel should save the
+//	use and dirty bits of the old entry before overwriting it.
+//
+//	"vpn" -- the virtual page that missed (for a superpage entry, 
+//		the page divided by SuperPageSize; see TLBSet)
+//----------------------------------------------------------------------
+
+int
+Machine::TLBVictim(int vpn)
+{
+    int first = TLBSet(vpn);
+    int *hand = &tlbHand[first / tlbWays];
+    int i, victim = first;
+
+    for (i = first; i < first + tlbWays; i++)
+	if (!tlb[i].valid)
+	    return i;
+
+    switch (tlbPolicy) {
+      case RandomTLB:
+	victim = first + Random() % tlbWays;
+	break;
+      case FifoTLB:
+	victim = first + *hand;
+	*hand = (*hand + 1) % tlbWays;
+	break;
+      case ClockTLB:
+	while (tlbReferenced[first + *hand]) {	// give it a second chance
+	    tlbReferenced[first + *hand] = FALSE;
+	    *hand = (*hand + 1) % tlbWays;
+	}
+	victim = first + *hand;
+	*hand = (*hand + 1) % tlbWays;
+	break;
+      default:
+	ASSERT(FALSE);
+    }
+    tlbReferenced[victim] = FALSE;
+    stats->numTLBEvictions++;
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTranslations
+// 	Forget every translation remembered in "softTLB".  They are
+//	only good as long as the page table (or TLB) entries they came
+//	from are unchanged -- in particular, as long as nobody clears the
+//	use or dirty bits, which we would then fail to set again.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushTranslations()
+{
+    for (int i = 0; i < SoftTLBSize; i++)
+	softTLB[i].virtualPage = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::DoTranslate
 // 	Translate a virtual address into a physical address, using 
 //	either a page table or a TLB.  Check for alignment and all sorts 
 //	of other errors, and if everything is ok, set the use/dirty bits in 
@@ -191,52 +412,85 @@ Machine::WriteMem(int addr, int size, int value)
 //	"physAddr" -- the place to store the physical address
 //	"size" -- the amount of memory being read or written
 // 	"writing" -- if TRUE, check the "read-only" bit in the TLB
+//
+//	Whether there is a TLB can't change once the machine is built,
+//	and debugging output is almost never wanted, so rather than
+//	check each time, we have a version of this routine for each
+//	combination of "trace" and "useTLB"; see Machine::Specialize.
 //----------------------------------------------------------------------
 
+template <bool trace, bool useTLB>
 ExceptionType
-Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
+Machine::DoTranslate(int virtAddr, int* physAddr, int size, bool writing)
 {
     int i;
     unsigned int vpn, offset;
     TranslationEntry *entry;
     unsigned int pageFrame;
 
-    DEBUG('a', "\tTranslate 0x%x, %s: ", virtAddr, writing ? "write" : "read");
+    if (trace)
+	DEBUG('a', "\tTranslate 0x%x, %s: ", virtAddr, writing ? "write" : "read");
 
 // check for alignment errors
     if (((size == 4) && (virtAddr & 0x3)) || ((size == 2) && (virtAddr & 0x1))){
-	DEBUG('a', "alignment problem at %d, size %d!\n", virtAddr, size);
+	if (trace)
+	    DEBUG('a', "alignment problem at %d, size %d!\n", virtAddr, size);
 	return AddressErrorException;
     }
     
     // we must have either a TLB or a page table, but not both!
-    ASSERT(tlb == NULL || pageTable == NULL);	
-    ASSERT(tlb != NULL || pageTable != NULL);	
+    if (useTLB) {
+	ASSERT(tlb != NULL && pageTable == NULL);
+    } else {
+	ASSERT(tlb == NULL && pageTable != NULL);
+    }
 
 // calculate the virtual page number, and offset within the page,
 // from the virtual address
     vpn = (unsigned) virtAddr / PageSize;
     offset = (unsigned) virtAddr % PageSize;
     
-    if (tlb == NULL) {		// => page table => vpn is index into table
+    if (!useTLB) {		// => page table => vpn is index into table
 	if (vpn >= pageTableSize) {
-	    DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
-			virtAddr, pageTableSize);
+	    if (trace)
+		DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
+			    virtAddr, pageTableSize);
 	    return AddressErrorException;
 	} else if (!pageTable[vpn].valid) {
-	    DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
-			virtAddr, pageTableSize);
+	    if (trace)
+		DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
+			    virtAddr, pageTableSize);
 	    return PageFaultException;
 	}
 	entry = &pageTable[vpn];
-    } else {
-        for (entry = NULL, i = 0; i < TLBSize; i++)
-    	    if (tlb[i].valid && ((unsigned) tlb[i].virtualPage == vpn)) {
+    } else {				// search vpn's set, and the set
+					// of the superpage it is part of
+	unsigned int superVPN = vpn & ~(SuperPageSize - 1);
+	int first = TLBSet(vpn);
+	int superFirst = TLBSet(vpn / SuperPageSize);
+
+        for (entry = NULL, i = first; i < first + tlbWays; i++)
+    	    if (tlb[i].valid && tlb[i].asid == asid
+		    && (unsigned) tlb[i].virtualPage
+			== (tlb[i].superPage ? superVPN : vpn)) {
 		entry = &tlb[i];			// FOUND!
 		break;
 	    }
-	if (entry == NULL) {				// not found
-    	    DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
+	if (entry == NULL && superFirst != first)
+	    for (i = superFirst; i < superFirst + tlbWays; i++)
+		if (tlb[i].valid && tlb[i].asid == asid && tlb[i].superPage
+			&& (unsigned) tlb[i].virtualPage == superVPN) {
+		    entry = &tlb[i];
+		    break;
+		}
+	if (entry != NULL) {
+	    if (!shadowing) {
+		tlbReferenced[i] = TRUE;
+		stats->numTLBHits++;
+	    }
+	} else {					// not found
+	    if (trace)
+		DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
     	    return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
 						// but not in the TLB
@@ -244,22 +498,53 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     }
 
     if (entry->readOnly && writing) {	// trying to write to a read-only page
-	DEBUG('a', "%d mapped read-only at %d in TLB!\n", virtAddr, i);
+	if (trace && useTLB)
+	    DEBUG('a', "%d mapped read-only at %d in TLB!\n", virtAddr, i);
+	else if (trace)
+	    DEBUG('a', "%d mapped read-only in page table!\n", virtAddr);
 	return ReadOnlyException;
     }
     pageFrame = entry->physicalPage;
+    if (useTLB && entry->superPage)
+	pageFrame += vpn - entry->virtualPage;
 
     // if the pageFrame is too big, there is something really wrong! 
     // An invalid translation was loaded into the page table or TLB. 
-    if (pageFrame >= NumPhysPages) { 
-	DEBUG('a', "*** frame %d > %d!\n", pageFrame, NumPhysPages);
+    if (pageFrame >= (unsigned) numPhysPages) { 
+	if (trace)
+	    DEBUG('a', "*** frame %d > %d!\n", pageFrame, numPhysPages);
 	return BusErrorException;
     }
+    *physAddr = pageFrame * PageSize + offset;
+    ASSERT((*physAddr >= 0) && ((*physAddr + size) <= memorySize));
+    if (trace)
+	DEBUG('a', "phys addr = 0x%x\n", *physAddr);
+    if (shadowing)		// the reference simulator, checking the
+	return NoException;	// engine, must leave no trace (see Verify)
+
     entry->use = TRUE;		// set the use, dirty bits
     if (writing)
 	entry->dirty = TRUE;
-    *physAddr = pageFrame * PageSize + offset;
-    ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
-    DEBUG('a', "phys addr = 0x%x\n", *physAddr);
+
+    // remember the translation, for SoftTranslate
+    softTLB[vpn % SoftTLBSize].virtualPage = vpn;
+    softTLB[vpn % SoftTLBSize].frameAddr = pageFrame * PageSize;
+    softTLB[vpn % SoftTLBSize].writable = entry->dirty && !entry->readOnly;
     return NoException;
 }
+
+// The versions of DoTranslate, DoReadMem and DoWriteMem that 
+// Machine::Specialize can choose from.
+
+#define SPECIALIZE(trace, useTLB)					\
+    template ExceptionType Machine::DoTranslate<trace, useTLB>		\
+			(int virtAddr, int *physAddr, int size, bool writing); \
+    template bool Machine::DoReadMem<trace, useTLB>			\
+			(int addr, int size, int *value);		\
+    template bool Machine::DoWriteMem<trace, useTLB>			\
+			(int addr, int size, int value);
+
+SPECIALIZE(false, false)
+SPECIALIZE(false, true)
+SPECIALIZE(true, false)
+SPECIALIZE(true, true)
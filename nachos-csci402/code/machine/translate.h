@@ -40,6 +40,15 @@ class TranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
+    int asid;		// In a TLB entry, the address space the mapping 
+			// belongs to: it is only used while Machine::asid
+			// is the same.  Not used in a page table.
+    bool superPage;	// In a TLB entry, if this bit is set, the entry
+			// maps SuperPageSize pages: "virtualPage" and 
+			// "physicalPage" are the first of each, and must
+			// be multiples of SuperPageSize.  The use, dirty
+			// and read-only bits cover all of them.  Not used
+			// in a page table.
 };
 
 #endif
@@ -0,0 +1,150 @@
+// verify.cc
+//	Routines for checking a fast execution engine against the
+//	reference simulator ("-verify").
+//
+//	The engine being checked runs the user program as usual, and
+//	the reference simulator (Machine::OneInstruction) follows it,
+//	on a copy of the registers and physical memory taken at the
+//	last checkpoint.  Every so often -- at least every
+//	"verifyInterval" instructions, and whenever the kernel is about
+//	to get control -- we run the reference simulator on its copy
+//	for as many instructions as the engine has executed since the
+//	checkpoint, and compare the results.  The copies are then
+//	brought up to date with the real thing, since only the real
+//	registers and memory see what the kernel does.
+//
+//	If the engine is about to raise an exception, the reference
+//	simulator must raise the same one on the next instruction.
+//	While it runs, RaiseException just records the exception, so
+//	that the kernel never sees the reference simulator at all.
+//
+//	Nor does the engine: the reference simulator reads and decodes
+//	each instruction itself, rather than use the predecoded copies,
+//	and it doesn't touch "softTLB", the use and dirty bits, the TLB
+//	statistics, or the predecoded and translated code its stores
+//	would otherwise update.  So a stale copy of the code in the
+//	engine shows up as a divergence.
+//
+//	Each divergence is reported with the PCs at both ends of the
+//	interval, and the registers and memory words that differ.
+
+#include "copyright.h"
+#include "machine.h"
+#include "system.h"
+
+#define MaxReported	8	// differing memory words reported, at most
+
+//----------------------------------------------------------------------
+// Machine::Checkpoint
+// 	Copy the registers and memory, as the starting point for the
+//	reference simulator.
+//
+//	"pending" -- the number of instructions that have executed, but
+//		that Tick has still to count (and that the reference
+//		simulator must therefore not run again)
+//----------------------------------------------------------------------
+
+void
+Machine::Checkpoint(int pending)
+{
+    memcpy(shadowRegisters, registers, sizeof(registers));
+    memcpy(shadowMemory, mainMemory, memorySize);
+    checkpointTime = Now() + pending * UserTick;
+}
+
+//----------------------------------------------------------------------
+// Machine::SinceCheckpoint
+// 	Return the number of instructions counted since the checkpoint.
+//----------------------------------------------------------------------
+
+int
+Machine::SinceCheckpoint()
+{
+    return (int) ((Now() - checkpointTime) / UserTick);
+}
+
+//----------------------------------------------------------------------
+// Machine::Verify
+// 	Run the reference simulator from the checkpoint, and check that
+//	it gets to the same state as the engine.
+//
+//	"count" -- the number of instructions the engine has executed
+//		since the checkpoint
+//	"which" -- the exception the engine is raising on the next
+//		instruction, or NoException
+//	"badVAddr" -- the address that caused it
+//----------------------------------------------------------------------
+
+void
+Machine::Verify(int count, ExceptionType which, int badVAddr)
+{
+    Instruction instr;
+    int savedRegisters[NumTotalRegs];
+    char *savedMemory;
+    bool *savedDecoded;
+    BlockCache *savedBlockCache;
+    SoftTLBEntry savedSoftTLB[SoftTLBSize];
+    int i, done, reported;
+    int startPC = shadowRegisters[PCReg];	// where the checkpoint was
+    bool same;
+
+    // Run the reference simulator on the copies.
+    memcpy(savedRegisters, registers, sizeof(registers));
+    memcpy(registers, shadowRegisters, sizeof(registers));
+    savedMemory = mainMemory;
+    mainMemory = shadowMemory;
+    savedDecoded = pageDecoded;		// so stores don't redecode
+    pageDecoded = shadowDecoded;
+    savedBlockCache = blockCache;	// nor invalidate blocks
+    blockCache = NULL;
+    memcpy(savedSoftTLB, softTLB, sizeof(softTLB));
+    FlushTranslations();		// so every access translates
+    shadowing = TRUE;
+    shadowException = NoException;
+    for (done = 0; done < count && shadowException == NoException; done++)
+	OneInstruction(&instr);
+    if (which != NoException && shadowException == NoException)
+	OneInstruction(&instr);		// should raise "which"
+    else if (shadowException != NoException)
+	done--;				// didn't complete
+    shadowing = FALSE;
+    memcpy(shadowRegisters, registers, sizeof(registers));
+    memcpy(registers, savedRegisters, sizeof(registers));
+    mainMemory = savedMemory;
+    pageDecoded = savedDecoded;
+    blockCache = savedBlockCache;
+    memcpy(softTLB, savedSoftTLB, sizeof(softTLB));
+
+    numVerified++;
+    same = (done == count && shadowException == which
+	    && (which == NoException || shadowBadVAddr == badVAddr)
+	    && memcmp(registers, shadowRegisters, sizeof(registers)) == 0
+	    && memcmp(mainMemory, shadowMemory, memorySize) == 0);
+    if (same)
+	return;
+
+    numDiverged++;
+    printf("Verify: engine diverged from the reference simulator between "
+	   "PC 0x%x and PC 0x%x (%d instructions, time %lld)\n",
+	   startPC, registers[PCReg], count,
+	   (long long) Now());
+    if (done != count || shadowException != which)
+	printf("\texception after %d instructions: reference %d (0x%x), "
+	       "engine %d (0x%x) after %d\n", done, shadowException,
+	       shadowBadVAddr, which, badVAddr, count);
+    else if (which != NoException && shadowBadVAddr != badVAddr)
+	printf("\tbad address: reference 0x%x, engine 0x%x\n",
+	       shadowBadVAddr, badVAddr);
+    for (i = 0; i < NumTotalRegs; i++)
+	if (registers[i] != shadowRegisters[i])
+	    printf("\tregister %d: reference 0x%x, engine 0x%x\n", i,
+		   shadowRegisters[i], registers[i]);
+    for (i = 0, reported = 0; i < memorySize; i += 4)
+	if (memcmp(&mainMemory[i], &shadowMemory[i], 4) != 0
+		&& reported++ < MaxReported)
+	    printf("\tmemory 0x%x: reference 0x%x, engine 0x%x\n", i,
+		   WordToHost(*(unsigned int *) &shadowMemory[i]),
+		   WordToHost(*(unsigned int *) &mainMemory[i]));
+    if (reported > MaxReported)
+	printf("\t... and %d more memory words\n", reported - MaxReported);
+}
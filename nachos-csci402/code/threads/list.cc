@@ -201,6 +201,25 @@ List::SortedInsert(void *item, int64_t sortKey)
     }
 }
 
+//----------------------------------------------------------------------
+// List::SortedPeek
+//      Return the first "item" on the list without removing it, and
+//	set *keyPtr to its priority value.
+//
+// Returns:
+//	Pointer to the first item, NULL if nothing on the list.
+//----------------------------------------------------------------------
+
+void *
+List::SortedPeek(int64_t *keyPtr)
+{
+    if (IsEmpty()) 
+	return NULL;
+    if (keyPtr != NULL)
+        *keyPtr = first->key;
+    return first->item;
+}
+
 //----------------------------------------------------------------------
 // List::SortedRemove
 //      Remove the first "item" from the front of a sorted list.
@@ -57,6 +57,8 @@ class List {
     // Routines to put/get items on/off list in order (sorted by key)
     void SortedInsert(void *item, int64_t sortKey);	// Put item into list
     void *SortedRemove(int64_t *keyPtr); 	  	// Remove first item from list
+    void *SortedPeek(int64_t *keyPtr);		// Look at first item, but
+						// leave it on the list
 
   private:
     ListElement *first;  	// Head of the list, NULL if list is empty
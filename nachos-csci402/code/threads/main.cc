@@ -9,7 +9,10 @@
 // 	Most of this file is not needed until later assignments.
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
+//		-s -cpu <engine> -verify <interval> -mem <pages> -hugemem
+//		-tlb <entries> -tlbways <n> -tlbrepl <policy>
+//		-pagerepl <policy> -rsslimit <pages> -wswindow <ticks>
+//		-x <nachos file> -c <consoleIn> <consoleOut>
 //		-f -cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
@@ -22,6 +25,23 @@
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
+//    -cpu selects how user instructions are simulated: "reference"
+//	(the default), "threaded", "block" or "jit"
+//    -verify runs the reference simulator alongside the engine, and
+//	reports any difference; the two are compared at least every
+//	<interval> instructions
+//    -mem sets the size of physical memory, in pages (default 32), and
+//	-hugemem asks the host to back it with huge pages
+//    -tlb, -tlbways and -tlbrepl (only with USE_TLB) set the number of
+//	TLB entries, the entries in each set (default: all of them), and
+//	how the entry to replace is chosen: "random" (the default),
+//	"fifo" or "clock"
+//    -pagerepl (only with VM) sets how the page to evict from memory
+//	is chosen: "fifo", "clock" (the default) or "lru"
+//    -rsslimit (only with VM) sets the most pages a process may have
+//	in memory (default: all of memory), and -wswindow how many 
+//	ticks a page stays in a process's working set after it's used
+//	(default 20000)
 //    -x runs a user program
 //    -c tests the console
 //
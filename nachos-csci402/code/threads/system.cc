@@ -29,6 +29,20 @@ SynchDisk   *synchDisk;
 
 #ifdef USER_PROGRAM	// requires either FILESYS or FILESYS_STUB
 Machine *machine;	// user program memory and registers
+FrameAllocator *frameAllocator;	// which frames of "machine" are free
+
+#define AgingTicks	(int64_t)1000LL	// time between samples of the use bits
+#endif
+
+#ifdef USE_TLB
+InvertedPageTable *ipt;		// what is in each frame, for TLB misses
+#endif
+
+#ifdef VM
+SwapSpace *swapSpace;		// where evicted pages go
+PageReplacer *pageReplacer;	// which pages to evict
+PageoutDaemon *pageoutDaemon;	// keeps some frames free
+LoadControl *loadControl;	// how much memory each process gets
 #endif
 
 #ifdef NETWORK
@@ -64,6 +78,93 @@ TimerInterruptHandler(int dummy)
 	interrupt->YieldOnReturn();
 }
 
+#ifdef USER_PROGRAM
+//----------------------------------------------------------------------
+// AgingInterruptHandler
+// 	Interrupt handler for the page aging clock, which samples the use
+//	bits every AgingTicks, to approximate LRU for page replacement.
+//	Unlike the time-slice timer, it runs whether or not -rs was given,
+//	and at fixed intervals, so that each bit of a frame's aging 
+//	counter covers the same amount of time.
+//
+//	The clock is just an interrupt that reschedules itself; as an
+//	AgingInt, it doesn't keep an idle machine from halting, nor move
+//	the clock when it does.
+//
+//	"dummy" is because every interrupt handler takes one argument.
+//----------------------------------------------------------------------
+static void
+AgingInterruptHandler(int dummy)
+{
+    machine->AgePages();
+    interrupt->Schedule(AgingInterruptHandler, 0, AgingTicks, AgingInt);
+}
+
+//----------------------------------------------------------------------
+// ParseEngine
+// 	Convert the argument to "-cpu" into the execution engine the
+//	machine simulation should use.
+//----------------------------------------------------------------------
+static CPUEngine
+ParseEngine(char *name)
+{
+    if (!strcmp(name, "reference"))
+	return ReferenceEngine;
+    if (!strcmp(name, "threaded"))
+	return ThreadedEngine;
+    if (!strcmp(name, "block"))
+	return BlockEngine;
+    if (!strcmp(name, "jit"))
+	return JitEngine;
+    printf("Unknown CPU engine \"%s\"; use reference, threaded, block or jit\n",
+	   name);
+    Exit(1);
+    return ReferenceEngine;		// not reached
+}
+#endif
+
+#ifdef USE_TLB
+//----------------------------------------------------------------------
+// ParsePolicy
+// 	Convert the argument to "-tlbrepl" into a TLB replacement policy.
+//----------------------------------------------------------------------
+static TLBPolicy
+ParsePolicy(char *name)
+{
+    if (!strcmp(name, "random"))
+	return RandomTLB;
+    if (!strcmp(name, "fifo"))
+	return FifoTLB;
+    if (!strcmp(name, "clock"))
+	return ClockTLB;
+    printf("Unknown TLB policy \"%s\"; use random, fifo or clock\n", name);
+    Exit(1);
+    return RandomTLB;			// not reached
+}
+#endif
+
+#ifdef VM
+//----------------------------------------------------------------------
+// ParseReplacement
+// 	Convert the argument to "-pagerepl" into a page replacement 
+//	policy.
+//----------------------------------------------------------------------
+static ReplacementPolicy
+ParseReplacement(char *name)
+{
+    if (!strcmp(name, "fifo"))
+	return FifoReplacement;
+    if (!strcmp(name, "clock"))
+	return ClockReplacement;
+    if (!strcmp(name, "lru"))
+	return LruReplacement;
+    printf("Unknown page replacement policy \"%s\"; use fifo, clock or lru\n",
+	   name);
+    Exit(1);
+    return FifoReplacement;		// not reached
+}
+#endif
+
 //----------------------------------------------------------------------
 // Initialize
 // 	Initialize Nachos global data structures.  Interpret command
@@ -83,6 +184,20 @@ Initialize(int argc, char **argv)
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
+    CPUEngine cpuEngine = ReferenceEngine; // how to run user instructions
+    int verify = 0;		// check it against the reference engine
+    int physPages = NumPhysPages; // size of physical memory
+    bool hugePages = FALSE;	// back it with huge host pages
+#endif
+#ifdef USE_TLB
+    int tlbEntries = TLBSize;	// shape of the TLB
+    int tlbWays = 0;		// (0: fully associative)
+    TLBPolicy tlbPolicy = RandomTLB;
+#endif
+#ifdef VM
+    ReplacementPolicy pagePolicy = ClockReplacement;
+    int rssLimit = 0;		// most pages per process (0: all of memory)
+    int workingSetWindow = WorkingSetWindow;
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
@@ -111,6 +226,52 @@ Initialize(int argc, char **argv)
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
 	    debugUserProg = TRUE;
+	else if (!strcmp(*argv, "-cpu")) {
+	    ASSERT(argc > 1);
+	    cpuEngine = ParseEngine(*(argv + 1));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-verify")) {
+	    ASSERT(argc > 1);
+	    verify = atoi(*(argv + 1));
+	    ASSERT(verify > 0);
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-mem")) {
+	    ASSERT(argc > 1);
+	    physPages = atoi(*(argv + 1));
+	    ASSERT(physPages > 0 && physPages <= MaxPhysPages);
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-hugemem"))
+	    hugePages = TRUE;
+#endif
+#ifdef USE_TLB
+	if (!strcmp(*argv, "-tlb")) {
+	    ASSERT(argc > 1);
+	    tlbEntries = atoi(*(argv + 1));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-tlbways")) {
+	    ASSERT(argc > 1);
+	    tlbWays = atoi(*(argv + 1));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-tlbrepl")) {
+	    ASSERT(argc > 1);
+	    tlbPolicy = ParsePolicy(*(argv + 1));
+	    argCount = 2;
+	}
+#endif
+#ifdef VM
+	if (!strcmp(*argv, "-pagerepl")) {
+	    ASSERT(argc > 1);
+	    pagePolicy = ParseReplacement(*(argv + 1));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-rsslimit")) {
+	    ASSERT(argc > 1);
+	    rssLimit = atoi(*(argv + 1));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-wswindow")) {
+	    ASSERT(argc > 1);
+	    workingSetWindow = atoi(*(argv + 1));
+	    argCount = 2;
+	}
 #endif
 #ifdef FILESYS_NEEDED
 	if (!strcmp(*argv, "-f"))
@@ -148,7 +309,17 @@ Initialize(int argc, char **argv)
     CallOnUserAbort(Cleanup);			// if user hits ctl-C
     
 #ifdef USER_PROGRAM
-    machine = new Machine(debugUserProg);	// this must come first
+    machine = new Machine(debugUserProg, cpuEngine, verify, physPages,
+			  hugePages);	// this must come first
+#ifdef USE_TLB
+    machine->ConfigureTLB(tlbEntries, tlbWays > 0 ? tlbWays : tlbEntries,
+			  tlbPolicy);
+#endif
+    frameAllocator = new FrameAllocator(machine->numPhysPages);
+#ifdef USE_TLB
+    ipt = new InvertedPageTable(machine->numPhysPages);
+#endif
+    interrupt->Schedule(AgingInterruptHandler, 0, AgingTicks, AgingInt);
 #endif
 
 #ifdef FILESYS
@@ -159,6 +330,15 @@ Initialize(int argc, char **argv)
     fileSystem = new FileSystem(format);
 #endif
 
+#ifdef VM
+    swapSpace = new SwapSpace("SWAP", SwapPages);	// needs the file system
+    pageReplacer = new PageReplacer(machine->numPhysPages, pagePolicy);
+    pageoutDaemon = new PageoutDaemon(machine->numPhysPages);
+    loadControl = new LoadControl(machine->numPhysPages, 
+				  rssLimit > 0 ? rssLimit : machine->numPhysPages,
+				  workingSetWindow);
+#endif
+
 #ifdef NETWORK
     postOffice = new PostOffice(netname, rely, 10);
 #endif
@@ -176,7 +356,18 @@ Cleanup()
     delete postOffice;
 #endif
     
+#ifdef VM
+    delete loadControl;
+    delete pageoutDaemon;
+    delete pageReplacer;
+    delete swapSpace;
+#endif
+
 #ifdef USER_PROGRAM
+#ifdef USE_TLB
+    delete ipt;
+#endif
+    delete frameAllocator;
     delete machine;
 #endif
 
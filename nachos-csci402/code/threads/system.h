@@ -31,7 +31,25 @@ extern Timer *timer;				// the hardware alarm clock
 
 #ifdef USER_PROGRAM
 #include "machine.h"
+#include "frames.h"
 extern Machine* machine;	// user program memory and registers
+extern FrameAllocator *frameAllocator; // which frames of "machine" are free
+#endif
+
+#ifdef USE_TLB
+#include "ipt.h"
+extern InvertedPageTable *ipt;	// what is in each frame, for TLB misses
+#endif
+
+#ifdef VM
+#include "swap.h"
+#include "replace.h"
+#include "pageout.h"
+#include "loadctl.h"
+extern SwapSpace *swapSpace;	// where evicted pages go
+extern PageReplacer *pageReplacer; // which pages to evict
+extern PageoutDaemon *pageoutDaemon; // keeps some frames free
+extern LoadControl *loadControl; // how much memory each process gets
 #endif
 
 #ifdef FILESYS_NEEDED 		// FILESYS or FILESYS_STUB 
@@ -39,6 +39,7 @@ Thread::Thread(char *threadName_input) {
     status = JUST_CREATED;
 #ifdef USER_PROGRAM
     space = NULL;
+    copying = FALSE;
 #endif
 }
 
@@ -127,6 +127,9 @@ class Thread {
     void RestoreUserState();		// restore user-level register state
 
     AddrSpace *space;			// User code this thread is running.
+    bool copying;			// Is a system call of ours copying
+					// to or from user memory?  (It may
+					// yield in the middle, on a fault.)
 #endif
 };
 
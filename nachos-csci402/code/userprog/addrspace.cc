@@ -18,7 +18,6 @@
 #include "copyright.h"
 #include "system.h"
 #include "addrspace.h"
-#include "noff.h"
 #include "table.h"
 #include "synch.h"
 
@@ -78,103 +77,87 @@ void *Table::Remove(int i) {
     return f;
 }
 
-//----------------------------------------------------------------------
-// SwapHeader
-// 	Do little endian to big endian conversion on the bytes in the 
-//	object file header, in case the file was generated on a little
-//	endian machine, and we're now running on a big endian machine.
-//----------------------------------------------------------------------
+#ifdef USE_TLB
+// Address space IDs are handed out in order; when they run out, the
+// TLB is emptied and a new "generation" begins, in which every address
+// space has to get a new ID the next time it runs.  Entries tagged
+// with the IDs of address spaces that are not running survive context
+// switches, so switching back to a process finds its translations
+// still there.
+//
+// The TLB is loaded from the inverted page table ("ipt"), not from our
+// own page table, which just lists the frames we have.
 
-static void 
-SwapHeader (NoffHeader *noffH)
-{
-	noffH->noffMagic = WordToHost(noffH->noffMagic);
-	noffH->code.size = WordToHost(noffH->code.size);
-	noffH->code.virtualAddr = WordToHost(noffH->code.virtualAddr);
-	noffH->code.inFileAddr = WordToHost(noffH->code.inFileAddr);
-	noffH->initData.size = WordToHost(noffH->initData.size);
-	noffH->initData.virtualAddr = WordToHost(noffH->initData.virtualAddr);
-	noffH->initData.inFileAddr = WordToHost(noffH->initData.inFileAddr);
-	noffH->uninitData.size = WordToHost(noffH->uninitData.size);
-	noffH->uninitData.virtualAddr = WordToHost(noffH->uninitData.virtualAddr);
-	noffH->uninitData.inFileAddr = WordToHost(noffH->uninitData.inFileAddr);
-}
+static int nextASID = 0;		// next free ID in this generation
+static int currentGeneration = 1;	// generation 0 means "none yet"
+#endif
 
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
-// 	Create an address space to run a user program.
-//	Load the program from a file "executable", and set everything
+// 	Create an address space to run a user program, and set everything
 //	up so that we can start executing user instructions.
 //
-//	Assumes that the object code file is in NOFF format.
+//	None of the program is in memory yet: each page gets a frame
+//	when it's first used (see PageFault).  So a program can be larger 
+//	than physical memory, as long as the part of it in use fits.
 //
-//	"executable" is the file containing the object code to load into memory
-//
-//      It's possible to fail to fully construct the address space for
-//      several reasons, including being unable to allocate memory,
-//      and being unable to read key parts of the executable.
-//      Incompletely consretucted address spaces have the member
-//      constructed set to false.
+//	"program" is the image of the program to run
 //----------------------------------------------------------------------
 
-AddrSpace::AddrSpace(OpenFile *executable) : fileTable(MaxOpenFiles) {
-    NoffHeader noffH;
+AddrSpace::AddrSpace(ProgramImage *program) : fileTable(MaxOpenFiles) {
+    NoffHeader *noffH = &program->header;
     unsigned int i, size;
 
     // Don't allocate the input or output to disk files
     fileTable.Put(0);
     fileTable.Put(0);
 
-    executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
-    if ((noffH.noffMagic != NOFFMAGIC) && 
-		(WordToHost(noffH.noffMagic) == NOFFMAGIC))
-    	SwapHeader(&noffH);
-    ASSERT(noffH.noffMagic == NOFFMAGIC);
-
-    size = noffH.code.size + noffH.initData.size + noffH.uninitData.size ;
+    image = program;
+    size = noffH->code.size + noffH->initData.size + noffH->uninitData.size ;
     numPages = divRoundUp(size, PageSize) + divRoundUp(UserStackSize,PageSize);
                                                 // we need to increase the size
 						// to leave room for the stack
     size = numPages * PageSize;
 
-    ASSERT(numPages <= NumPhysPages);		// check we're not trying
-						// to run anything too big --
-						// at least until we have
-						// virtual memory
-
     DEBUG('a', "Initializing address space, num pages %d, size %d\n", 
 					numPages, size);
-// first, set up the translation 
+// set up the translation, with every page invalid.  Pages of the 
+// program's image will be shared, read-only.
     pageTable = new TranslationEntry[numPages];
+    copyOnWrite = new bool[numPages];
+#ifdef USE_TLB
+    superMapped = new bool[divRoundUp(numPages, SuperPageSize)];
+    for (i = 0; i < divRoundUp(numPages, SuperPageSize); i++)
+	superMapped[i] = FALSE;
+#endif
     for (i = 0; i < numPages; i++) {
-	pageTable[i].virtualPage = i;	// for now, virtual page # = phys page #
-	pageTable[i].physicalPage = i;
-	pageTable[i].valid = TRUE;
+	pageTable[i].virtualPage = i;
+	pageTable[i].physicalPage = -1;
+	pageTable[i].valid = FALSE;
 	pageTable[i].use = FALSE;
 	pageTable[i].dirty = FALSE;
-	pageTable[i].readOnly = FALSE;  // if the code segment was entirely on 
-					// a separate page, we could set its 
-					// pages to be read-only
-    }
-    
-// zero out the entire address space, to zero the unitialized data segment 
-// and the stack segment
-    bzero(machine->mainMemory, size);
-
-// then, copy in the code and data segments into memory
-    if (noffH.code.size > 0) {
-        DEBUG('a', "Initializing code segment, at 0x%x, size %d\n", 
-			noffH.code.virtualAddr, noffH.code.size);
-        executable->ReadAt(&(machine->mainMemory[noffH.code.virtualAddr]),
-			noffH.code.size, noffH.code.inFileAddr);
+	pageTable[i].readOnly = image->IsShared(i);
+	pageTable[i].superPage = FALSE;
+	copyOnWrite[i] = image->IsShared(i) && !image->IsCode(i);
     }
-    if (noffH.initData.size > 0) {
-        DEBUG('a', "Initializing data segment, at 0x%x, size %d\n", 
-			noffH.initData.virtualAddr, noffH.initData.size);
-        executable->ReadAt(&(machine->mainMemory[noffH.initData.virtualAddr]),
-			noffH.initData.size, noffH.initData.inFileAddr);
+#ifdef VM
+    swapSlot = new int[numPages];
+    readAhead = new bool[numPages];
+    for (i = 0; i < numPages; i++) {
+	swapSlot[i] = -1;
+	readAhead[i] = FALSE;
     }
-
+    lastFault = -1;
+    stride = 0;
+    window = ReadAheadPages;
+    image->AddSharer(this);
+    residentSet = loadControl->Add(this);
+#endif
+
+#ifdef USE_TLB
+    asid = -1;
+    asidGeneration = 0;			// get an ID when we first run
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -186,7 +169,48 @@ AddrSpace::AddrSpace(OpenFile *executable) : fileTable(MaxOpenFiles) {
 
 AddrSpace::~AddrSpace()
 {
+    unsigned int i;
+
+#ifdef VM
+    loadControl->Remove(residentSet);
+#endif
+    // don't leave translations of our code lying around for the
+    // next program to load into our own frames, and give the frames 
+    // back (shared ones stay with the program's image)
+#ifdef USE_TLB
+    // nor our entries in the TLB
+    if (asidGeneration == currentGeneration) {
+	for (i = 0; i < (unsigned) machine->tlbSize; i++)
+	    if (machine->tlb[i].asid == asid)
+		machine->tlb[i].valid = FALSE;
+	machine->FlushTranslations();
+    }
+#endif
+    for (i = 0; i < numPages; i++) {
+	if (!pageTable[i].valid)
+	    continue;
+	if (!pageTable[i].readOnly) {
+	    machine->InvalidateCode(pageTable[i].physicalPage);
+#ifdef USE_TLB
+	    ipt->Remove(pageTable[i].physicalPage);
+#endif
+	}
+	frameAllocator->Free(pageTable[i].physicalPage);
+    }
+#ifdef VM
+    for (i = 0; i < numPages; i++)
+	if (swapSlot[i] != -1)
+	    swapSpace->Free(swapSlot[i]);
+    delete [] swapSlot;
+    delete [] readAhead;
+    image->RemoveSharer(this);
+#endif
+    image->Release();
     delete pageTable;
+    delete [] copyOnWrite;
+#ifdef USE_TLB
+    delete [] superMapped;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -226,22 +250,560 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, nothing!
+//	Without a TLB, that means the use bits of our page table, which
+//	the machine only samples while it is the one in use.  (Our TLB
+//	entries can stay, and are sampled wherever they are.)
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState() 
-{}
+{
+#ifndef USE_TLB
+    machine->SampleUseBits(pageTable, numPages);
+#endif
+}
 
 //----------------------------------------------------------------------
 // AddrSpace::RestoreState
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      Without a TLB, tell the machine where to find the page table.
+//	With one, just tell it our address space ID: the TLB may still
+//	hold our entries from the last time we ran.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
+#ifdef USE_TLB
+    if (asidGeneration != currentGeneration)
+	AllocateASID();
+    machine->asid = asid;
+#else
     machine->pageTable = pageTable;
     machine->pageTableSize = numPages;
+#endif
+    machine->FlushTranslations();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageFault
+// 	Handle a page fault (with a TLB, a TLB miss) at "virtAddr": if 
+//	the page isn't in memory, give it a frame, and then, with a TLB,
+//	load its translation.  Returns FALSE if "virtAddr" isn't in the
+//	address space, or there's no memory for it.
+//
+//	With virtual memory, we may also read ahead of the fault; and 
+//	since a page that was read ahead has never been in the TLB, the
+//	first use of it comes here too, and we can tell it was worth it.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageFault(int virtAddr)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+
+    if (vpn >= numPages)
+	return FALSE;
+    if (!pageTable[vpn].valid) {
+	stats->numPageFaults++;
+#ifdef VM
+	loadControl->PageFault(residentSet);	// may suspend us
+#endif
+	if (!PageIn(vpn)) {
+	    printf("Out of memory for page %d\n", vpn);
+	    return FALSE;
+	}
+#ifdef VM
+	ReadAhead(vpn);
+	if (!pageTable[vpn].valid && !PageIn(vpn)) {	// read too far
+	    printf("Out of memory for page %d\n", vpn);
+	    return FALSE;
+	}
+#endif
+    }
+#ifdef VM
+    else if (readAhead[vpn]) {
+	readAhead[vpn] = FALSE;		// the stream got this far
+	lastFault = vpn;
+	window = min(window + 1, MaxReadAhead);
+    }
+#endif
+#ifdef USE_TLB
+    return LoadTLB(virtAddr);
+#else
+    return TRUE;
+#endif
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+// 	Give page "vpn" a frame.  A page of the program's image we haven't
+//	written gets the frame shared by everyone running the program, 
+//	read from the executable if need be.  Any other page gets a frame 
+//	of its own, with its contents read back from swap if it was 
+//	evicted, or zeroed if it's never been written (uninitialized 
+//	data or stack).
+//
+//	With a TLB, the first use of any page in a whole, aligned group 
+//	of SuperPageSize private pages gives the group an aligned run of
+//	frames, if there is one, so that a single TLB entry can map it.
+//
+//	Returns FALSE if there's no frame to be had.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageIn(int vpn)
+{
+    int frame, first, pages, i;
+
+    if (pageTable[vpn].readOnly) {
+	if ((frame = image->Share(vpn)) == -1)
+	    return FALSE;
+	pageTable[vpn].physicalPage = frame;
+	pageTable[vpn].valid = TRUE;
+	return TRUE;
+    }
+
+    first = vpn;
+    pages = 1;
+    frame = -1;
+#ifdef USE_TLB
+    first = vpn - vpn % SuperPageSize;
+    if (first + SuperPageSize <= (int) numPages
+#ifdef VM
+	&& loadControl->MayGrow(residentSet, SuperPageSize)
+#endif
+	) {
+	for (i = first; i < first + SuperPageSize; i++)
+	    if (image->IsShared(i) || pageTable[i].valid)
+		break;
+	if (i == first + SuperPageSize)
+	    frame = frameAllocator->AllocateRun(SuperPageSize);
+    }
+    if (frame != -1) {
+	pages = SuperPageSize;
+	superMapped[vpn / SuperPageSize] = TRUE;
+    } else
+	first = vpn;
+#endif
+    if (frame == -1) {
+#ifdef VM
+	if (!loadControl->MayGrow(residentSet, 1))
+	    ReplaceOwnPage();
+	frame = pageReplacer->GetFrame();
+#else
+	frame = frameAllocator->Allocate();
+#endif
+	if (frame == -1)
+	    return FALSE;
+    }
+    DEBUG('a', "Paging in pages %d to %d, to frames %d to %d\n", first,
+	  first + pages - 1, frame, frame + pages - 1);
+    for (i = 0; i < pages; i++) {
+	pageTable[first + i].physicalPage = frame + i;
+	pageTable[first + i].valid = TRUE;
+#ifdef VM
+	if (swapSlot[first + i] != -1)
+	    swapSpace->Read(swapSlot[first + i], frame + i);
+	else
+#endif
+	bzero(&machine->mainMemory[(frame + i) * PageSize], PageSize);
+	machine->InvalidateCode(frame + i);
+#ifdef USE_TLB
+	ipt->Insert(frame + i, this, first + i, FALSE);
+#endif
+#ifdef VM
+	pageReplacer->Loaded(frame + i);
+	residentSet->numResident++;
+#endif
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyOnWrite
+// 	Handle a write to the read-only page at "virtAddr": if it's a 
+//	shared page of initialized data, give it a frame of its own, with
+//	a copy of the data, and make it writable.  Returns FALSE if the 
+//	page is really read-only (it holds code).
+//
+//	We give up the shared frame before getting our own, since getting
+//	one may mean evicting the shared page; so the data goes by way of
+//	a buffer.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyOnWrite(int virtAddr)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    char data[PageSize];
+    int frame;
+
+    if (vpn >= numPages || !copyOnWrite[vpn])
+	return FALSE;
+    DEBUG('a', "Copying shared page %d from frame %d\n", vpn, 
+	  pageTable[vpn].physicalPage);
+    memcpy(data, &machine->mainMemory[pageTable[vpn].physicalPage * PageSize],
+	   PageSize);
+#ifdef USE_TLB
+    FlushTLBPage(vpn);			// the TLB may map the shared frame
+#endif
+    frameAllocator->Free(pageTable[vpn].physicalPage);
+    pageTable[vpn].valid = FALSE;
+    pageTable[vpn].readOnly = FALSE;
+    copyOnWrite[vpn] = FALSE;
+
+#ifdef VM
+    if (!loadControl->MayGrow(residentSet, 1))
+	ReplaceOwnPage();
+    frame = pageReplacer->GetFrame();
+#else
+    frame = frameAllocator->Allocate();
+#endif
+    if (frame == -1) {
+	printf("Out of memory for page %d\n", vpn);
+	return FALSE;
+    }
+    memcpy(&machine->mainMemory[frame * PageSize], data, PageSize);
+    machine->InvalidateCode(frame);
+    pageTable[vpn].physicalPage = frame;
+    pageTable[vpn].valid = TRUE;
+#ifdef USE_TLB
+    ipt->Insert(frame, this, vpn, FALSE);
+    ipt->Entry(frame)->dirty = TRUE;	// it isn't in the executable
+#endif
+#ifdef VM
+    pageReplacer->Loaded(frame);
+    residentSet->numResident++;
+#endif
+    return TRUE;
+}
+
+#ifdef VM
+//----------------------------------------------------------------------
+// AddrSpace::ReadAhead
+// 	After a page fault on "vpn", if the last two faults were the same
+//	number of pages apart, guess that the program is stepping through
+//	memory, and bring in the next "window" pages along the way (all 
+//	of them in this one fault), so it doesn't fault on each.
+//
+//	The window grows as pages read ahead are used, and shrinks when 
+//	they are evicted without having been used.  We never take more 
+//	than a quarter of memory for pages that might not be used, nor
+//	go over our allocation when memory is short, and stop if reading
+//	ahead evicts the page we faulted on (the caller then brings it 
+//	back).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ReadAhead(int vpn)
+{
+    int delta = vpn - lastFault;
+    int limit = min(window, machine->numPhysPages / 4);
+    int page, i;
+
+    lastFault = vpn;
+    if (delta == 0 || delta != stride) {
+	stride = delta;
+	return;
+    }
+    for (i = 0, page = vpn + stride; i < limit; i++, page += stride) {
+	if (page < 0 || page >= (int) numPages)
+	    break;
+	if (pageTable[page].valid)
+	    continue;
+	if (!loadControl->MayGrow(residentSet, 1) || !PageIn(page))
+	    break;
+	stats->numReadAheads++;
+	// (a page that got a superpage can't be followed: it's used
+	// without missing in the TLB)
+	readAhead[page] = !superMapped[page / SuperPageSize];
+	if (!pageTable[vpn].valid)
+	    break;
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Unused
+// 	Page "vpn" is being evicted: if it was read ahead and never 
+//	used, we read too far, so read less next time.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Unused(int vpn)
+{
+    if (!readAhead[vpn])
+	return;
+    readAhead[vpn] = FALSE;
+    stats->numReadAheadsUnused++;
+    window = max(window / 2, 1);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Evict
+// 	Take private page "vpn" out of memory, to free its frame.  If
+//	it's been written since it was last in swap (or ever, if it was
+//	never there), write it to swap; otherwise the copy there, or the
+//	zeros it started as, will do.
+//
+//	Evicting a page from a superpage splits the superpage up: the
+//	rest of its pages are mapped by TLB entries of their own, from
+//	then on.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Evict(int vpn)
+{
+    int frame = pageTable[vpn].physicalPage;
+
+    ASSERT(pageTable[vpn].valid && !pageTable[vpn].readOnly);
+    Unused(vpn);
+    FlushTLBPage(vpn);			// getting its dirty bit into the ipt
+    superMapped[vpn / SuperPageSize] = FALSE;
+    if (ipt->Entry(frame)->dirty) {
+	if (swapSlot[vpn] == -1)
+	    swapSlot[vpn] = swapSpace->Allocate();
+	ASSERT(swapSlot[vpn] != -1);	// the swap file is full
+	swapSpace->Write(swapSlot[vpn], frame);
+    }
+    pageTable[vpn].valid = FALSE;
+    ipt->Remove(frame);
+    frameAllocator->Free(frame);
+    residentSet->numResident--;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Clean
+// 	For the pageout daemon: if private page "vpn" has been written 
+//	since it was last in swap, write it there now, and mark it clean,
+//	so that evicting it won't have to.  It stays in memory.  Return
+//	whether it was written.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Clean(int vpn)
+{
+    int frame = pageTable[vpn].physicalPage;
+
+    ASSERT(pageTable[vpn].valid && !pageTable[vpn].readOnly);
+    FlushTLBPage(vpn);			// getting its dirty bit into the ipt
+    if (!ipt->Entry(frame)->dirty)
+	return FALSE;
+    if (swapSlot[vpn] == -1)
+	swapSlot[vpn] = swapSpace->Allocate();
+    if (swapSlot[vpn] == -1)
+	return FALSE;			// the swap file is full; leave it
+    swapSpace->Write(swapSlot[vpn], frame);
+    ipt->Entry(frame)->dirty = FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Unshare
+// 	The program's image is evicting shared page "vpn": if we map it,
+//	stop, and give up our reference to its frame.  The next use of
+//	the page will fault.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Unshare(int vpn)
+{
+    if ((unsigned) vpn >= numPages || !pageTable[vpn].valid
+	|| !pageTable[vpn].readOnly)
+	return;
+    Unused(vpn);
+    FlushTLBPage(vpn);
+    pageTable[vpn].valid = FALSE;
+    frameAllocator->Free(pageTable[vpn].physicalPage);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::WorkingSet
+// 	Return how many of our private pages in memory have been used 
+//	(or loaded) since "since" ticks, as far as the machine's use 
+//	bits tell.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::WorkingSet(int64_t since)
+{
+    unsigned int vpn;
+    int pages = 0;
+
+    for (vpn = 0; vpn < numPages; vpn++)
+	if (pageTable[vpn].valid && !pageTable[vpn].readOnly
+	    && pageReplacer->LastUsed(pageTable[vpn].physicalPage) >= since)
+	    pages++;
+    return pages;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReplaceOwnPage
+// 	We're at the resident-set limit, or at our allocation while
+//	memory is short: make room for a page by evicting our own private
+//	page used least recently, rather than someone else's.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ReplaceOwnPage()
+{
+    unsigned int vpn;
+    int victim = -1;
+
+    machine->SampleUses();		// bring the use times up to date
+    for (vpn = 0; vpn < numPages; vpn++)
+	if (pageTable[vpn].valid && !pageTable[vpn].readOnly
+	    && (victim == -1 
+		|| pageReplacer->LastUsed(pageTable[vpn].physicalPage)
+		   < pageReplacer->LastUsed(pageTable[victim].physicalPage)))
+	    victim = vpn;
+    if (victim == -1)
+	return;				// nothing of our own to give up
+    DEBUG('a', "Replacing our own page %d\n", victim);
+    stats->numEvictions++;
+    Evict(victim);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SwapOut
+// 	We're being suspended: take all our pages out of memory, writing
+//	the dirty ones to swap as one batch.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::SwapOut()
+{
+    unsigned int vpn;
+
+    swapSpace->BeginBatch();
+    for (vpn = 0; vpn < numPages; vpn++) {
+	if (!pageTable[vpn].valid)
+	    continue;
+	if (pageTable[vpn].readOnly)
+	    Unshare(vpn);
+	else {
+	    stats->numEvictions++;
+	    Evict(vpn);
+	}
+    }
+    swapSpace->EndBatch();
+}
+#endif
+
+#ifdef USE_TLB
+//----------------------------------------------------------------------
+// AddrSpace::AllocateASID
+// 	Get an address space ID for this generation.  If there are none
+//	left, start a new generation: empty the TLB, and take all the
+//	IDs back (each address space gets a new one when it next runs).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::AllocateASID()
+{
+    int i;
+
+    if (nextASID == NumASIDs) {
+	DEBUG('a', "Out of address space IDs, emptying the TLB\n");
+	for (i = 0; i < machine->tlbSize; i++)
+	    EvictTLBEntry(i);
+	currentGeneration++;
+	nextASID = 0;
+    }
+    asid = nextASID++;
+    asidGeneration = currentGeneration;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::EvictTLBEntry
+// 	Empty entry "i" of the TLB, first letting the machine sample its
+//	use bit, and copying its dirty bit back to the inverted page
+//	table (the entry need not belong to the running address space).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::EvictTLBEntry(int i)
+{
+    TranslationEntry *entry = &machine->tlb[i];
+    int frame, pages = entry->superPage ? SuperPageSize : 1;
+
+    if (!entry->valid)
+	return;
+    machine->SampleUseBits(entry, 1);
+    for (frame = entry->physicalPage; frame < entry->physicalPage + pages;
+	 frame++)
+	ipt->Entry(frame)->dirty |= entry->dirty;
+    entry->valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FlushTLBPage
+// 	Empty any entry of the TLB that maps page "vpn" of this address
+//	space, either on its own or as part of a superpage, saving its
+//	use and dirty bits.  If our address space ID isn't current, none
+//	of the entries are ours.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::FlushTLBPage(int vpn)
+{
+    TranslationEntry *entry;
+    int i;
+
+    if (asidGeneration != currentGeneration)
+	return;
+    for (i = 0; i < machine->tlbSize; i++) {
+	entry = &machine->tlb[i];
+	if (entry->valid && entry->asid == asid 
+	    && (entry->superPage ? entry->virtualPage == vpn - vpn % SuperPageSize
+				 : entry->virtualPage == vpn))
+	    EvictTLBEntry(i);
+    }
+    machine->FlushTranslations();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadTLB
+// 	Handle a TLB miss at "virtAddr": look up the translation in the
+//	inverted page table, and load it into the entry the machine's 
+//	replacement policy picks.  Returns FALSE if the page isn't in
+//	memory.
+//
+//	Pages we share with other address spaces running our program are
+//	in the table under the program's image.  If the page is part of 
+//	a group that has a run of frames of its own, we load a superpage
+//	entry that maps the whole group.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::LoadTLB(int virtAddr)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    TranslationEntry *entry;
+    int i;
+
+    if (vpn >= numPages || !pageTable[vpn].valid)
+	return FALSE;
+    if (pageTable[vpn].readOnly)
+	entry = ipt->Lookup(image, vpn);
+    else
+	entry = ipt->Lookup(this, vpn);
+    if (entry == NULL)
+	return FALSE;
+    if (superMapped[vpn / SuperPageSize]) {
+	i = machine->TLBVictim(vpn / SuperPageSize);
+	EvictTLBEntry(i);
+	machine->tlb[i] = *entry;
+	machine->tlb[i].virtualPage -= vpn % SuperPageSize;
+	machine->tlb[i].physicalPage -= vpn % SuperPageSize;
+	machine->tlb[i].superPage = TRUE;
+    } else {
+	i = machine->TLBVictim(vpn);
+	EvictTLBEntry(i);
+	machine->tlb[i] = *entry;
+	machine->tlb[i].superPage = FALSE;
+    }
+    machine->tlb[i].asid = asid;
+    return TRUE;
 }
+#endif
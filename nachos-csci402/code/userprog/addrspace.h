@@ -15,18 +15,28 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "image.h"
 #include "table.h"
+#ifdef VM
+#include "loadctl.h"
+#endif
 
 #define UserStackSize		1024 	// increase this as necessary!
 
+#ifdef VM
+#define ReadAheadPages		4	// pages to read ahead of a stream of
+					// page faults, at first
+#define MaxReadAhead		32	// ... and at most
+#endif
+
 #define MaxOpenFiles 256
 #define MaxChildSpaces 256
 
 class AddrSpace {
   public:
-    AddrSpace(OpenFile *executable);	// Create an address space,
-					// initializing it with the program
-					// stored in the file "executable"
+    AddrSpace(ProgramImage *program);	// Create an address space, running
+					// "program" (we take over the
+					// caller's reference to it)
     ~AddrSpace();			// De-allocate an address space
 
     void InitRegisters();		// Initialize user-level CPU registers,
@@ -36,11 +46,66 @@ class AddrSpace {
     void RestoreState();		// info on a context switch
     Table fileTable;			// Table of openfiles
 
+    bool PageFault(int virtAddr);	// Make the page at "virtAddr" 
+					// accessible, after a page fault
+					// (or TLB miss); return FALSE if 
+					// it isn't in the address space
+    bool CopyOnWrite(int virtAddr);	// Give the page at "virtAddr" a 
+					// private copy, after a write to a
+					// shared page; return FALSE if it
+					// really is read-only
+#ifdef VM
+    void Evict(int vpn);		// Take private page "vpn" out of 
+					// memory, writing it to swap if need be
+    bool Clean(int vpn);		// Write private page "vpn" to swap
+					// if it's dirty, keeping it in memory
+    void Unshare(int vpn);		// Stop mapping shared page "vpn"
+    AddrSpace *nextSharer;		// the next address space running
+					// the same program (see image.h)
+    int WorkingSet(int64_t since);	// How many of our private pages 
+					// have been used since "since"?
+    void SwapOut();			// Take all our pages out of memory
+#endif
+
  private:
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    ProgramImage *image;		// the program we're running
+    bool *copyOnWrite;			// for each page, is it shared until
+					// we write it?
+    bool PageIn(int vpn);		// Give page "vpn" a frame
+#ifdef USE_TLB
+    int asid;				// tags our entries in the TLB
+    int asidGeneration;			// "asid" is only ours while this
+					// matches; see AllocateASID
+    bool *superMapped;			// for each group of SuperPageSize
+					// pages, are they in a run of frames,
+					// so one TLB entry can map them?
+    void AllocateASID();
+    bool LoadTLB(int virtAddr);		// Load the TLB with the translation
+					// for "virtAddr"; return FALSE if 
+					// the page isn't in memory
+    static void EvictTLBEntry(int i);	// empty entry "i" of the TLB
+    void FlushTLBPage(int vpn);		// empty our entries mapping "vpn"
+#endif
+#ifdef VM
+    int *swapSlot;			// for each page, where in swap its
+					// contents are, or -1
+    bool *readAhead;			// for each page, was it read ahead,
+					// and not used yet?
+    int lastFault;			// the last page faulted on (or read
+					// ahead, and then used)
+    int stride;				// pages between the last two faults
+    int window;				// how many pages to read ahead
+    void ReadAhead(int vpn);		// Read ahead of a fault on "vpn"
+    void Unused(int vpn);		// "vpn" is leaving memory: was it
+					// read ahead for nothing?
+    ResidentSet *residentSet;		// our memory use, for load control
+    void ReplaceOwnPage();		// Evict our least recently used 
+					// private page
+#endif
 };
 
 #endif // ADDRSPACE_H
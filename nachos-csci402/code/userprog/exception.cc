@@ -33,29 +33,12 @@ int copyin(unsigned int vaddr, int len, char *buf) {
     // Copy len bytes from the current thread's virtual address vaddr.
     // Return the number of bytes so read, or -1 if an error occors.
     // Errors can generally mean a bad virtual address was passed in.
-    bool result;
-    int n=0;			// The number of bytes copied in
-    int *paddr = new int;
-
-    while ( n >= 0 && n < len) {
-      result = machine->ReadMem( vaddr, 1, paddr );
-      while(!result) // FALL 09 CHANGES
-	  {
-   			result = machine->ReadMem( vaddr, 1, paddr ); // FALL 09 CHANGES: TO HANDLE PAGE FAULT IN THE ReadMem SYS CALL
-	  }	
-      
-      buf[n++] = *paddr;
-     
-      if ( !result ) {
-	//translation failed
-	return -1;
-      }
-
-      vaddr++;
-    }
+    int n;
 
-    delete paddr;
-    return len;
+    currentThread->copying = TRUE;
+    n = machine->CopyIn(vaddr, len, buf);
+    currentThread->copying = FALSE;
+    return n;
 }
 
 int copyout(unsigned int vaddr, int len, char *buf) {
@@ -63,21 +46,11 @@ int copyout(unsigned int vaddr, int len, char *buf) {
     // Return the number of bytes so written, or -1 if an error
     // occors.  Errors can generally mean a bad virtual address was
     // passed in.
-    bool result;
-    int n=0;			// The number of bytes copied in
-
-    while ( n >= 0 && n < len) {
-      // Note that we check every byte's address
-      result = machine->WriteMem( vaddr, 1, (int)(buf[n++]) );
-
-      if ( !result ) {
-	//translation failed
-	return -1;
-      }
-
-      vaddr++;
-    }
+    int n;
 
+    currentThread->copying = TRUE;
+    n = machine->CopyOut(vaddr, len, buf);
+    currentThread->copying = FALSE;
     return n;
 }
 
@@ -275,6 +248,15 @@ void ExceptionHandler(ExceptionType which) {
 	machine->WriteRegister(PCReg,machine->ReadRegister(NextPCReg));
 	machine->WriteRegister(NextPCReg,machine->ReadRegister(PCReg)+4);
 	return;
+    } else if (which == PageFaultException
+	       && currentThread->space->PageFault(machine->ReadRegister(BadVAddrReg))) {
+	return;			// the instruction will be retried
+    } else if (which == ReadOnlyException
+	       && currentThread->space->CopyOnWrite(machine->ReadRegister(BadVAddrReg))) {
+	return;			// the write will be retried, to our own copy
+    } else if (currentThread->copying) {
+	return;			// a bad pointer passed to a system call;
+				// copyin or copyout will return -1
     } else {
       cout<<"Unexpected user mode exception - which:"<<which<<"  type:"<< type<<endl;
       interrupt->Halt();
@@ -0,0 +1,153 @@
+// frames.cc 
+//	Routines to allocate and free physical page frames.
+//
+//	No synchronization is needed: simulated time doesn't advance
+//	while we update the stack of free frames, so no interrupt (and
+//	no context switch) can happen in the middle.  Interrupt handlers
+//	must not allocate frames.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "frames.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// FrameAllocator::FrameAllocator
+// 	Initialize the allocator, with every frame free.  Frames are
+//	handed out lowest first, so a single program gets the same
+//	frames it would have when virtual and physical page numbers
+//	were the same.
+//
+//	"nframes" is the number of frames of physical memory
+//----------------------------------------------------------------------
+
+FrameAllocator::FrameAllocator(int nframes)
+{
+    numFrames = nframes;
+    freeFrames = new int[numFrames];
+    refs = new int[numFrames];
+    position = new int[numFrames];
+    for (int i = 0; i < numFrames; i++) {
+	freeFrames[i] = numFrames - 1 - i;
+	position[numFrames - 1 - i] = i;
+	refs[i] = 0;
+    }
+    numFree = numFrames;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::~FrameAllocator
+// 	De-allocate the allocator's data structures.
+//----------------------------------------------------------------------
+
+FrameAllocator::~FrameAllocator()
+{
+    delete [] freeFrames;
+    delete [] refs;
+    delete [] position;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Allocate
+// 	Take a frame off the free stack, and return its number, or -1 if
+//	all of memory is in use.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::Allocate()
+{
+    int frame = -1;
+
+    if (numFree > 0) {
+	frame = freeFrames[numFree - 1];
+	Take(frame);
+    }
+    DEBUG('a', "Allocated frame %d, %d left\n", frame, numFree);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::AllocateRun
+// 	Find "count" free frames in a row, the first a multiple of 
+//	"count", for a superpage.  Unlike Allocate, this takes time
+//	proportional to the size of memory, since it has to look for
+//	them; so it's meant for when a program is loaded.
+//
+//	Returns the first frame, or -1 if there is no such run.
+//----------------------------------------------------------------------
+
+int
+FrameAllocator::AllocateRun(int count)
+{
+    int first, frame;
+
+    for (first = 0; first + count <= numFrames; first += count) {
+	for (frame = first; frame < first + count; frame++)
+	    if (refs[frame] > 0)
+		break;
+	if (frame == first + count) {
+	    for (frame = first; frame < first + count; frame++)
+		Take(frame);
+	    DEBUG('a', "Allocated frames %d to %d, %d left\n", first,
+		  first + count - 1, numFree);
+	    return first;
+	}
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Take
+// 	Mark free "frame" as in use, with one reference, moving the
+//	frame on top of the stack into its place.
+//
+//	With virtual memory, this is where memory running low is noticed:
+//	we tell the pageout daemon how many frames are left.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Take(int frame)
+{
+    int top = freeFrames[--numFree];
+
+    ASSERT(refs[frame] == 0);
+    freeFrames[position[frame]] = top;
+    position[top] = position[frame];
+    refs[frame] = 1;
+#ifdef VM
+    pageoutDaemon->FramesLeft(numFree);
+#endif
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Share
+// 	Add a reference to "frame", which must be in use: another 
+//	address space is mapping it.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Share(int frame)
+{
+    ASSERT(frame >= 0 && frame < numFrames && refs[frame] > 0);
+    refs[frame]++;
+}
+
+//----------------------------------------------------------------------
+// FrameAllocator::Free
+// 	Drop a reference to "frame", and if it was the last, put the
+//	frame back on the free stack.  The caller must already have made
+//	sure nothing maps it any more, in that case.
+//----------------------------------------------------------------------
+
+void
+FrameAllocator::Free(int frame)
+{
+    ASSERT(frame >= 0 && frame < numFrames && refs[frame] > 0);
+    if (--refs[frame] > 0)
+	return;
+    position[frame] = numFree;
+    freeFrames[numFree++] = frame;
+}
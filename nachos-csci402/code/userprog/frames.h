@@ -0,0 +1,55 @@
+// frames.h 
+//	Data structures to keep track of which physical page frames are 
+//	free, so that several user programs can be in memory at once.
+//
+//	The free frames are kept on a stack, so that allocating or
+//	freeing one takes constant time, however much memory there is.
+//
+//	A frame can be mapped by more than one address space (when they
+//	share the code of a program), so each one has a count of 
+//	references, and only goes back on the stack when the last one
+//	is given up.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines the allocator of physical page frames.
+// There is one, shared by every address space.
+
+class FrameAllocator {
+  public:
+    FrameAllocator(int nframes);	// Initialize, with every one of
+					// "nframes" frames free
+    ~FrameAllocator();
+
+    int Allocate();			// Return the number of a free frame,
+					// now in use; -1 if there is none
+    int AllocateRun(int count);		// Return the first of "count" free
+					// frames in a row, starting at a
+					// multiple of "count"; -1 if there
+					// are none
+    void Share(int frame);		// Add a reference to "frame"
+    void Free(int frame);		// Drop a reference to "frame", 
+					// returning it to the free pool if 
+					// it was the last
+    int NumFree() { return numFree; }	// How many frames are free?
+
+  private:
+    int numFrames;			// frames in physical memory
+    int *freeFrames;			// stack of free frames
+    int numFree;			// how many are on the stack
+    int *refs;				// for each frame, how many references
+					// there are to it (0 if it's free)
+    int *position;			// for each free frame, where it is 
+					// in "freeFrames"
+    void Take(int frame);		// remove "frame" from the stack
+};
+
+#endif // FRAMES_H
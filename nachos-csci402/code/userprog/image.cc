@@ -0,0 +1,305 @@
+// image.cc 
+//	Routines to load programs into memory, and share them among the
+//	address spaces running them.
+//
+//	The images in memory are kept on a list, which is searched by 
+//	name; there are never many programs running at once.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "image.h"
+#include "addrspace.h"
+#include "string.h"
+
+extern "C" { int bzero(char *, int); };
+
+static ProgramImage *images = NULL;	// the programs in memory
+
+//----------------------------------------------------------------------
+// SwapHeader
+// 	Do little endian to big endian conversion on the bytes in the 
+//	object file header, in case the file was generated on a little
+//	endian machine, and we're now running on a big endian machine.
+//----------------------------------------------------------------------
+
+static void 
+SwapHeader (NoffHeader *noffH)
+{
+	noffH->noffMagic = WordToHost(noffH->noffMagic);
+	noffH->code.size = WordToHost(noffH->code.size);
+	noffH->code.virtualAddr = WordToHost(noffH->code.virtualAddr);
+	noffH->code.inFileAddr = WordToHost(noffH->code.inFileAddr);
+	noffH->initData.size = WordToHost(noffH->initData.size);
+	noffH->initData.virtualAddr = WordToHost(noffH->initData.virtualAddr);
+	noffH->initData.inFileAddr = WordToHost(noffH->initData.inFileAddr);
+	noffH->uninitData.size = WordToHost(noffH->uninitData.size);
+	noffH->uninitData.virtualAddr = WordToHost(noffH->uninitData.virtualAddr);
+	noffH->uninitData.inFileAddr = WordToHost(noffH->uninitData.inFileAddr);
+}
+
+//----------------------------------------------------------------------
+// Overlaps
+// 	Return TRUE if "segment" has anything in virtual page "vpn".
+//----------------------------------------------------------------------
+
+static bool
+Overlaps(Segment *segment, int vpn)
+{
+    return segment->size > 0 && segment->virtualAddr < (vpn + 1) * PageSize
+	   && segment->virtualAddr + segment->size > vpn * PageSize;
+}
+
+//----------------------------------------------------------------------
+// SegmentEnd
+// 	Return the virtual address just past "segment".
+//----------------------------------------------------------------------
+
+static int
+SegmentEnd(Segment *segment)
+{
+    return segment->size > 0 ? segment->virtualAddr + segment->size : 0;
+}
+
+//----------------------------------------------------------------------
+// ProgramImage::Open
+// 	Return the image of the program in the executable "fileName",
+//	with a reference for the caller.  If no one is running the
+//	program, load it.  Returns NULL if there's no such file.
+//----------------------------------------------------------------------
+
+ProgramImage *
+ProgramImage::Open(char *fileName)
+{
+    ProgramImage *image;
+    OpenFile *executable;
+
+    for (image = images; image != NULL; image = image->next)
+	if (!strcmp(image->name, fileName)) {
+	    DEBUG('a', "Sharing the image of %s\n", fileName);
+	    image->refs++;
+	    return image;
+	}
+    if ((executable = fileSystem->Open(fileName)) == NULL)
+	return NULL;
+    image = new ProgramImage(fileName, executable);
+    image->next = images;
+    images = image;
+    return image;
+}
+
+//----------------------------------------------------------------------
+// ProgramImage::Release
+// 	Drop the caller's reference to the image, and if it was the last,
+//	take the image out of memory.  The caller must already have 
+//	given up its references to our frames.
+//----------------------------------------------------------------------
+
+void
+ProgramImage::Release()
+{
+    ProgramImage **link;
+
+    if (--refs > 0)
+	return;
+    for (link = &images; *link != this; link = &(*link)->next)
+	ASSERT(*link != NULL);
+    *link = next;
+    delete this;
+}
+
+//----------------------------------------------------------------------
+// ProgramImage::ProgramImage
+// 	Set up the image of the program in "executable".  Its pages are
+//	read in as they are first used (see Share).
+//
+//	Assumes that the object code file is in NOFF format.
+//
+//	"fileName" is the name of the executable
+//	"executable" is the file containing the object code
+//----------------------------------------------------------------------
+
+ProgramImage::ProgramImage(char *fileName, OpenFile *executable)
+{
+    int i;
+
+    name = new char[strlen(fileName) + 1];
+    strcpy(name, fileName);
+    file = executable;
+    refs = 1;
+#ifdef VM
+    sharers = NULL;
+#endif
+
+    file->ReadAt((char *)&header, sizeof(header), 0);
+    if ((header.noffMagic != NOFFMAGIC) && 
+		(WordToHost(header.noffMagic) == NOFFMAGIC))
+    	SwapHeader(&header);
+    ASSERT(header.noffMagic == NOFFMAGIC);
+
+    numPages = divRoundUp(max(SegmentEnd(&header.code),
+			      SegmentEnd(&header.initData)), PageSize);
+    DEBUG('a', "Opening the image of %s, num pages %d\n", name, numPages);
+
+// a page is shared if it holds any code or initialized data; it's 
+// read-only for good if it holds nothing else
+    inImage = new bool[numPages];
+    frames = new int[numPages];
+    codeOnly = new bool[numPages];
+    for (i = 0; i < numPages; i++) {
+	inImage[i] = Overlaps(&header.code, i) 
+		     || Overlaps(&header.initData, i);
+	codeOnly[i] = Overlaps(&header.code, i) 
+		      && !Overlaps(&header.initData, i)
+		      && !Overlaps(&header.uninitData, i);
+	frames[i] = -1;
+    }
+}
+
+//----------------------------------------------------------------------
+// ProgramImage::~ProgramImage
+// 	Give back the image's frames, and close the executable.
+//----------------------------------------------------------------------
+
+ProgramImage::~ProgramImage()
+{
+    int i;
+
+    DEBUG('a', "Unloading the image of %s\n", name);
+    for (i = 0; i < numPages; i++)
+	if (frames[i] != -1) {
+	    machine->InvalidateCode(frames[i]);
+#ifdef USE_TLB
+	    ipt->Remove(frames[i]);
+#endif
+	    frameAllocator->Free(frames[i]);
+	}
+    delete [] inImage;
+    delete [] frames;
+    delete [] codeOnly;
+    delete file;
+    delete [] name;
+}
+
+//----------------------------------------------------------------------
+// ProgramImage::Share
+// 	Return the frame holding shared page "virtualPage", with a new 
+//	reference for the caller, which must give it back with 
+//	frameAllocator->Free.  If the page isn't in memory yet, read it
+//	into a frame of its own; the frame holds one reference for the
+//	image itself, which keeps it in memory while address spaces come
+//	and go.
+//
+//	Returns -1 if the page has to be read in, and there's no free
+//	frame to read it into.
+//----------------------------------------------------------------------
+
+int
+ProgramImage::Share(int virtualPage)
+{
+    ASSERT(IsShared(virtualPage));
+    if (frames[virtualPage] == -1) {
+#ifdef VM
+	frames[virtualPage] = pageReplacer->GetFrame();
+#else
+	frames[virtualPage] = frameAllocator->Allocate();
+#endif
+	if (frames[virtualPage] == -1)
+	    return -1;
+	LoadPage(virtualPage);
+#ifdef USE_TLB
+	ipt->Insert(frames[virtualPage], this, virtualPage, TRUE);
+#endif
+#ifdef VM
+	pageReplacer->Loaded(frames[virtualPage]);
+#endif
+    }
+    frameAllocator->Share(frames[virtualPage]);
+    return frames[virtualPage];
+}
+
+//----------------------------------------------------------------------
+// ProgramImage::LoadPage
+// 	Read the parts of the code and initialized data segments that
+//	are in "virtualPage" into its frame, and zero the rest of it.
+//----------------------------------------------------------------------
+
+void
+ProgramImage::LoadPage(int virtualPage)
+{
+    Segment *segments[2] = { &header.code, &header.initData };
+    Segment *segment;
+    char *frame = &machine->mainMemory[frames[virtualPage] * PageSize];
+    int i, start, end;
+
+    DEBUG('a', "Reading page %d of %s into frame %d\n", virtualPage, name,
+	  frames[virtualPage]);
+    bzero(frame, PageSize);
+    for (i = 0; i < 2; i++) {
+	segment = segments[i];
+	if (!Overlaps(segment, virtualPage))
+	    continue;
+	start = max(segment->virtualAddr, virtualPage * PageSize);
+	end = min(segment->virtualAddr + segment->size,
+		  (virtualPage + 1) * PageSize);
+	file->ReadAt(&frame[start - virtualPage * PageSize], end - start,
+		     segment->inFileAddr + start - segment->virtualAddr);
+    }
+// we wrote the frame directly, so any predecoded code in it is stale
+    machine->InvalidateCode(frames[virtualPage]);
+}
+
+#ifdef VM
+//----------------------------------------------------------------------
+// ProgramImage::AddSharer
+// 	Note that "space" is running the program, so it may map our 
+//	frames.
+//----------------------------------------------------------------------
+
+void
+ProgramImage::AddSharer(AddrSpace *space)
+{
+    space->nextSharer = sharers;
+    sharers = space;
+}
+
+//----------------------------------------------------------------------
+// ProgramImage::RemoveSharer
+// 	Note that "space" no longer maps any of our frames.
+//----------------------------------------------------------------------
+
+void
+ProgramImage::RemoveSharer(AddrSpace *space)
+{
+    AddrSpace **link;
+
+    for (link = &sharers; *link != space; link = &(*link)->nextSharer)
+	ASSERT(*link != NULL);
+    *link = space->nextSharer;
+}
+
+//----------------------------------------------------------------------
+// ProgramImage::Evict
+// 	Take shared page "virtualPage" out of memory, to free its frame.
+//	Every address space mapping it gives up its reference, and then
+//	we give up ours.  The page is never dirty, so it can simply be
+//	read from the executable again.
+//----------------------------------------------------------------------
+
+void
+ProgramImage::Evict(int virtualPage)
+{
+    int frame = frames[virtualPage];
+    AddrSpace *space;
+
+    ASSERT(frame != -1);
+    for (space = sharers; space != NULL; space = space->nextSharer)
+	space->Unshare(virtualPage);
+    ipt->Remove(frame);
+    frameAllocator->Free(frame);
+    frames[virtualPage] = -1;
+}
+#endif
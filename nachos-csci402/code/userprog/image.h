@@ -0,0 +1,85 @@
+// image.h 
+//	Data structures to keep track of the programs being run, so that
+//	every address space running the same executable can share one
+//	copy of its code and initialized data.
+//
+//	The pages of code and initialized data are read from the 
+//	executable the first time any address space running the program
+//	touches them, into frames of their own, which stay in memory as
+//	long as any address space is running the program.  Each address 
+//	space maps those frames read-only: code pages for good, and data
+//	pages until the program first writes them, when it gets a private
+//	copy ("copy-on-write").  So starting another instance of a program
+//	costs no reads from the executable for the pages already touched,
+//	and only the memory for its stack, its uninitialized data, and the
+//	pages it writes.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "copyright.h"
+#include "filesys.h"
+#include "noff.h"
+
+class AddrSpace;
+
+// The following class defines the image of a program in memory.  
+// Images are found by the name of their executable, so programs run
+// under the same name share.
+
+class ProgramImage {
+  public:
+    static ProgramImage *Open(char *fileName);
+					// Return the image of the program in
+					// "fileName", loading it if it isn't
+					// in memory yet; NULL if the file
+					// can't be opened
+    void Release();			// The caller is done with the image;
+					// the last one to go frees it
+
+    NoffHeader header;			// where the program's segments are
+    int numPages;			// the pages holding code or data
+
+    bool IsShared(int virtualPage)	// Is the page one of ours?
+	{ return virtualPage < numPages && inImage[virtualPage]; }
+    bool IsCode(int virtualPage) { return codeOnly[virtualPage]; }
+					// Does the page hold nothing but 
+					// code (so it's never written)?
+    int Share(int virtualPage);		// Return the frame holding a shared
+					// page, reading it in if need be, 
+					// and counting a new reference; -1
+					// if there's no free frame
+#ifdef VM
+    void AddSharer(AddrSpace *space);	// "space" is running the program
+    void RemoveSharer(AddrSpace *space); // "space" is done with it
+    void Evict(int virtualPage);	// Take a shared page out of memory,
+					// and out of every address space
+#endif
+
+  private:
+    ProgramImage(char *fileName, OpenFile *executable);
+    ~ProgramImage();
+
+    void LoadPage(int virtualPage);	// Read a page into its frame
+
+    char *name;				// the executable's file name
+    OpenFile *file;			// the executable
+    int refs;				// how many address spaces use us
+    bool *inImage;			// for each page, is it shared (does
+					// it have code or initialized data)?
+    int *frames;			// for each shared page, the frame
+					// holding it, or -1 if it hasn't
+					// been read in
+    bool *codeOnly;			// for each page, is it all code?
+    ProgramImage *next;			// the next image in memory
+#ifdef VM
+    AddrSpace *sharers;			// the address spaces running us,
+					// linked through their "nextSharer"
+#endif
+};
+
+#endif // IMAGE_H
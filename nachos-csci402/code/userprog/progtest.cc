@@ -19,26 +19,24 @@
 
 //----------------------------------------------------------------------
 // StartProcess
-// 	Run a user program.  Open the executable, load it into
-//	memory, and jump to it.
+// 	Run a user program.  Find the program's image, loading it into
+//	memory if no one else is running it, and jump to it.
 //----------------------------------------------------------------------
 void
 StartProcess(char *filename)
 {
-    OpenFile *executable = fileSystem->Open(filename);
+    ProgramImage *program = ProgramImage::Open(filename);
     AddrSpace *space;
 
-    if (executable == NULL) {
+    if (program == NULL) {
 	printf("Unable to open file %s\n", filename);
 	return;
     }
    
-    space = new AddrSpace(executable);
+    space = new AddrSpace(program);
 
     currentThread->space = space;
 
-    delete executable;			// close file
-
     space->InitRegisters();		// set the initial register values
     space->RestoreState();		// load page table register
 
@@ -0,0 +1,133 @@
+// ipt.cc 
+//	Routines to manage the inverted page table.
+//
+//	Each hash bucket heads a chain of frames, linked through "next".
+//	There are at least as many buckets as frames, so the chains are
+//	short.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "ipt.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// InvertedPageTable::InvertedPageTable
+// 	Initialize the table, with nothing in any frame.
+//
+//	"nframes" is the number of frames of physical memory
+//----------------------------------------------------------------------
+
+InvertedPageTable::InvertedPageTable(int nframes)
+{
+    int i;
+
+    numFrames = nframes;
+    entries = new TranslationEntry[numFrames];
+    owners = new void *[numFrames];
+    next = new int[numFrames];
+    for (i = 0; i < numFrames; i++) {
+	entries[i].physicalPage = i;
+	entries[i].valid = FALSE;
+	owners[i] = NULL;
+	next[i] = -1;
+    }
+    for (numBuckets = 1; numBuckets < numFrames; numBuckets *= 2)
+	;
+    buckets = new int[numBuckets];
+    for (i = 0; i < numBuckets; i++)
+	buckets[i] = -1;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::~InvertedPageTable
+// 	De-allocate the table.
+//----------------------------------------------------------------------
+
+InvertedPageTable::~InvertedPageTable()
+{
+    delete [] entries;
+    delete [] owners;
+    delete [] next;
+    delete [] buckets;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Hash
+// 	Return the bucket for "virtualPage" of "owner".
+//----------------------------------------------------------------------
+
+int
+InvertedPageTable::Hash(void *owner, int virtualPage)
+{
+    unsigned long key = ((unsigned long) owner >> 4) * 2654435761UL
+			 + virtualPage;
+
+    return (int) (key & (numBuckets - 1));
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Insert
+// 	Record that "frame" now holds "virtualPage" of "owner", with its
+//	use and dirty bits clear.  The frame must be empty.
+//----------------------------------------------------------------------
+
+void
+InvertedPageTable::Insert(int frame, void *owner, int virtualPage,
+			  bool readOnly)
+{
+    TranslationEntry *entry = &entries[frame];
+    int bucket = Hash(owner, virtualPage);
+
+    ASSERT(frame >= 0 && frame < numFrames && !entry->valid);
+    entry->virtualPage = virtualPage;
+    entry->valid = TRUE;
+    entry->readOnly = readOnly;
+    entry->use = FALSE;
+    entry->dirty = FALSE;
+    entry->superPage = FALSE;
+    owners[frame] = owner;
+    next[frame] = buckets[bucket];
+    buckets[bucket] = frame;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Remove
+// 	Record that "frame" no longer holds anything.
+//----------------------------------------------------------------------
+
+void
+InvertedPageTable::Remove(int frame)
+{
+    TranslationEntry *entry = &entries[frame];
+    int *link;
+
+    ASSERT(frame >= 0 && frame < numFrames && entry->valid);
+    for (link = &buckets[Hash(owners[frame], entry->virtualPage)];
+	 *link != frame; link = &next[*link])
+	ASSERT(*link != -1);
+    *link = next[frame];
+    next[frame] = -1;
+    entry->valid = FALSE;
+    owners[frame] = NULL;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Lookup
+// 	Return the translation for "virtualPage" of "owner", or NULL if
+//	that page isn't in memory.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+InvertedPageTable::Lookup(void *owner, int virtualPage)
+{
+    int frame;
+
+    for (frame = buckets[Hash(owner, virtualPage)]; frame != -1;
+	 frame = next[frame])
+	if (owners[frame] == owner && entries[frame].virtualPage == virtualPage)
+	    return &entries[frame];
+    return NULL;
+}
@@ -0,0 +1,65 @@
+// ipt.h 
+//	Data structures for the inverted page table: one translation per
+//	physical page frame, saying which virtual page of which address
+//	space is in it.
+//
+//	With a software-loaded TLB, the kernel refills the TLB from here
+//	on a miss.  The entries are hashed on (owner, virtual page), so
+//	finding one takes constant time, however many address spaces
+//	there are and however large they are.
+//
+//	The owner of a page is normally an address space.  A page of a
+//	program that every address space running it shares is owned by
+//	the program's image instead (see image.h), since a frame can 
+//	only have one entry.  Shared pages are always read-only, and 
+//	private ones never are (a private copy of a shared page is 
+//	writable), so an entry's "readOnly" bit says which its owner is.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef IPT_H
+#define IPT_H
+
+#include "copyright.h"
+#include "translate.h"
+
+// The following class defines the inverted page table.  Entry "frame"
+// is the translation of whatever is in physical page "frame"; its
+// "physicalPage" is always "frame", and its "valid" bit says whether
+// anything is.
+
+class InvertedPageTable {
+  public:
+    InvertedPageTable(int nframes);	// Initialize, with every frame empty
+    ~InvertedPageTable();
+
+    void Insert(int frame, void *owner, int virtualPage, 
+		bool readOnly);		// Record that "frame" holds
+					// "virtualPage" of "owner"
+    void Remove(int frame);		// Record that "frame" is empty
+
+    TranslationEntry *Lookup(void *owner, int virtualPage);
+					// Return the translation of
+					// "virtualPage" of "owner", or NULL
+					// if it isn't in memory
+    TranslationEntry *Entry(int frame) { return &entries[frame]; }
+					// Return the translation of
+					// whatever is in "frame"
+    void *Owner(int frame) { return owners[frame]; }
+					// Return whose page is in "frame"
+
+  private:
+    int Hash(void *owner, int virtualPage);
+
+    int numFrames;
+    TranslationEntry *entries;		// one per frame
+    void **owners;			// the owner of each entry
+    int *next;				// next frame in the same hash chain,
+					// or -1
+    int *buckets;			// first frame in each hash chain
+    int numBuckets;			// a power of two
+};
+
+#endif // IPT_H
@@ -0,0 +1,302 @@
+// loadctl.cc 
+//	Routines for load control: page-fault frequency allocation of
+//	memory to processes, and suspending processes when there isn't
+//	enough memory for all of them.
+//
+//	Times are in ticks of the whole machine, since that's what the
+//	use bits are sampled in; so with several processes taking turns,
+//	each one's faults look further apart than they would alone.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "loadctl.h"
+#include "system.h"
+#include "addrspace.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// ResidentSet::ResidentSet
+// 	Initialize what we know about the memory use of a new process,
+//	running in "space": nothing in memory, and the smallest 
+//	allocation.
+//----------------------------------------------------------------------
+
+ResidentSet::ResidentSet(AddrSpace *addrSpace, int processId)
+{
+    space = addrSpace;
+    id = processId;
+    allocation = MinResidentPages;
+    numResident = 0;
+    suspended = FALSE;
+    resume = new Semaphore("resume", 0);
+    started = lastFault = stats->totalTicks;
+    numFaults = numSuspensions = peakWorkingSet = 0;
+    next = NULL;
+}
+
+//----------------------------------------------------------------------
+// ResidentSet::~ResidentSet
+// 	De-allocate a process's resident set.
+//----------------------------------------------------------------------
+
+ResidentSet::~ResidentSet()
+{
+    delete resume;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::LoadControl
+// 	Initialize the load controller, with no processes.
+//
+//	"nframes" is the number of frames of physical memory
+//	"maxResident" is the most pages a process may have in memory
+//	"ticks" is how long a page stays in the working set after it's
+//		used, and how close together page faults have to be for 
+//		a process to get more memory
+//----------------------------------------------------------------------
+
+LoadControl::LoadControl(int nframes, int maxResident, int ticks)
+{
+    available = nframes;
+    limit = maxResident;
+    window = ticks;
+    processes = NULL;
+    nextId = 0;
+    suspended = new List;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::~LoadControl
+// 	De-allocate the load controller.  Processes still running when
+//	Nachos halts are not cleaned up.
+//----------------------------------------------------------------------
+
+LoadControl::~LoadControl()
+{
+    delete suspended;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::Add
+// 	Note that a process is starting, in "space", and return its
+//	resident set.
+//----------------------------------------------------------------------
+
+ResidentSet *
+LoadControl::Add(AddrSpace *space)
+{
+    ResidentSet *process = new ResidentSet(space, nextId++);
+
+    process->allocation = min(process->allocation, limit);
+    process->next = processes;
+    processes = process;
+    return process;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::Remove
+// 	Note that "process" is finishing: print its stats, and see if
+//	the memory it had lets a suspended process run again.
+//----------------------------------------------------------------------
+
+void
+LoadControl::Remove(ResidentSet *process)
+{
+    ResidentSet **link;
+
+    ASSERT(!process->suspended);
+    PrintProcess(process);
+    for (link = &processes; *link != process; link = &(*link)->next)
+	ASSERT(*link != NULL);
+    *link = process->next;
+    delete process;
+    ResumeWaiting();
+}
+
+//----------------------------------------------------------------------
+// LoadControl::PageFault
+// 	"process" has faulted on a page that isn't in memory: adjust its
+//	allocation by how long it's been since its last fault.  If that
+//	was within the window, it needs more memory; if not, it needs 
+//	only its working set, and maybe a suspended process can now run.
+//
+//	Then if the allocations add up to more than there's memory for,
+//	and some other process is running, suspend this one.  It only 
+//	returns when there's room for it again.
+//----------------------------------------------------------------------
+
+void
+LoadControl::PageFault(ResidentSet *process)
+{
+    int64_t now = stats->totalTicks;
+
+    process->numFaults++;
+    if (now - process->lastFault <= window)
+	process->allocation = min(process->allocation + 1, limit);
+    else {
+	process->allocation = min(max(WorkingSet(process) + 1, 
+				      MinResidentPages), limit);
+	ResumeWaiting();
+    }
+    process->lastFault = now;
+    DEBUG('a', "Process %d faulted, allocation %d, resident %d\n",
+	  process->id, process->allocation, process->numResident);
+
+    if (Demand() > available && NumRunning() > 1)
+	Suspend(process);
+}
+
+//----------------------------------------------------------------------
+// LoadControl::MayGrow
+// 	Return whether "process" can take "pages" more frames of memory 
+//	without giving up any of its own: it mustn't go over the limit, 
+//	and if memory is short, and other processes need it, it mustn't
+//	go over its allocation.
+//----------------------------------------------------------------------
+
+bool
+LoadControl::MayGrow(ResidentSet *process, int pages)
+{
+    if (process->numResident + pages > limit)
+	return FALSE;
+    return process->numResident + pages <= process->allocation
+	|| !pageoutDaemon->MemoryShort() || NumRunning() == 1;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::Demand
+// 	Return the total allocation of the processes that aren't 
+//	suspended.
+//----------------------------------------------------------------------
+
+int
+LoadControl::Demand()
+{
+    ResidentSet *process;
+    int total = 0;
+
+    for (process = processes; process != NULL; process = process->next)
+	if (!process->suspended)
+	    total += process->allocation;
+    return total;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::NumRunning
+// 	Return how many processes aren't suspended.
+//----------------------------------------------------------------------
+
+int
+LoadControl::NumRunning()
+{
+    ResidentSet *process;
+    int count = 0;
+
+    for (process = processes; process != NULL; process = process->next)
+	if (!process->suspended)
+	    count++;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::Suspend
+// 	Suspend "process", which is the one running: evict all its 
+//	pages, and wait until the processes still running leave room 
+//	for its allocation.
+//----------------------------------------------------------------------
+
+void
+LoadControl::Suspend(ResidentSet *process)
+{
+    ASSERT(process->space == currentThread->space);
+    DEBUG('a', "Suspending process %d, demand %d of %d frames\n",
+	  process->id, Demand(), available);
+    process->suspended = TRUE;
+    process->numSuspensions++;
+    process->space->SwapOut();
+    suspended->Append((void *) process);
+    ResumeWaiting();			// its allocation may have been 
+					// keeping out an older one
+    process->resume->P();
+    process->lastFault = stats->totalTicks;	// its pages are gone
+    DEBUG('a', "Process %d resumed\n", process->id);
+}
+
+//----------------------------------------------------------------------
+// LoadControl::ResumeWaiting
+// 	Resume suspended processes, oldest first, as long as their
+//	allocations fit in memory along with those of the processes
+//	running -- and at least one, if none is running.
+//----------------------------------------------------------------------
+
+void
+LoadControl::ResumeWaiting()
+{
+    ResidentSet *process;
+
+    while (!suspended->IsEmpty()) {
+	process = (ResidentSet *) suspended->Remove();
+	if (NumRunning() > 0 && Demand() + process->allocation > available) {
+	    suspended->Prepend((void *) process);
+	    break;
+	}
+	process->suspended = FALSE;
+	process->resume->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// LoadControl::WorkingSet
+// 	Return the number of pages "process" has in memory that it has
+//	used within the window, after sampling the use bits.
+//----------------------------------------------------------------------
+
+int
+LoadControl::WorkingSet(ResidentSet *process)
+{
+    int pages;
+
+    machine->SampleUses();
+    pages = process->space->WorkingSet(stats->totalTicks - window);
+    process->peakWorkingSet = max(process->peakWorkingSet, pages);
+    return pages;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::PrintProcess
+// 	Print the memory stats of "process": its working set, its 
+//	resident set, and its page-fault rate (per thousand ticks it's
+//	been running).
+//----------------------------------------------------------------------
+
+void
+LoadControl::PrintProcess(ResidentSet *process)
+{
+    int64_t ticks = max(stats->totalTicks - process->started, (int64_t) 1);
+    int rate = (int) (process->numFaults * 100000LL / ticks);
+    int pages = WorkingSet(process);
+
+    printf("Process %d: working set %d (peak %d), resident %d "
+	   "(allocation %d), faults %d (%d.%02d per 1000 ticks), "
+	   "suspended %d\n", process->id, pages,
+	   process->peakWorkingSet, process->numResident, process->allocation,
+	   process->numFaults, rate / 100, rate % 100, process->numSuspensions);
+}
+
+//----------------------------------------------------------------------
+// LoadControl::Print
+// 	Print the memory stats of the processes still running (or 
+//	suspended), when Nachos halts.
+//----------------------------------------------------------------------
+
+void
+LoadControl::Print()
+{
+    ResidentSet *process;
+
+    for (process = processes; process != NULL; process = process->next)
+	PrintProcess(process);
+}
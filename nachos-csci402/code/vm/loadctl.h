@@ -0,0 +1,119 @@
+// loadctl.h 
+//	Data structures for load control: keeping track of how much
+//	memory each process needs, so that one program that needs a lot
+//	can't make every other one thrash.
+//
+//	Each process has a resident set -- the private pages it has in
+//	memory (shared pages of its program belong to the program's 
+//	image) -- and an allocation, the number of pages we think it
+//	needs, set by its page-fault frequency: each time it faults 
+//	within a window of ticks of its last fault, its allocation grows
+//	by a page; when it goes longer than that, its allocation shrinks
+//	to its working set, the pages it has used within the window (as
+//	far as the use bits, sampled by Machine::SampleUses, tell).
+//
+//	While memory is plentiful (or there's only one process), a 
+//	process can have more pages than its allocation; once it's short,
+//	a process at its allocation replaces its own pages, rather than 
+//	taking others'.  No process can have more pages than the 
+//	resident-set limit (-rsslimit).
+//
+//	When the allocations of all the processes add up to more than
+//	memory, the one that faulted is suspended: its pages are evicted,
+//	and it waits until the others' allocations leave room for it.
+//
+//	There is no Exec system call yet, so only the one process that
+//	StartProcess runs ever exists: local replacement and suspension
+//	can't happen until there is multiprogramming.  The allocation,
+//	working set and -rsslimit apply to that process already.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef LOADCTL_H
+#define LOADCTL_H
+
+#include "copyright.h"
+#include "utility.h"
+
+#define WorkingSetWindow	20000	// ticks a page stays in the working
+					// set after it's used (default)
+#define MinResidentPages	4	// smallest allocation
+
+class AddrSpace;			// (addrspace.h includes this file,
+class Semaphore;			// and synch.h includes addrspace.h)
+class List;
+
+// The following class defines what we know about the memory use of
+// one process.  The fields are public, for LoadControl and the
+// process's AddrSpace.
+
+class ResidentSet {
+  public:
+    ResidentSet(AddrSpace *space, int id);
+    ~ResidentSet();
+
+    AddrSpace *space;			// the process's address space
+    int id;				// numbers processes, for the stats
+    int allocation;			// pages it should have
+    int numResident;			// pages it has
+    bool suspended;			// is it waiting for memory?
+    Semaphore *resume;			// ... here
+    int64_t started;			// when it started, in ticks
+    int64_t lastFault;			// when it last faulted, in ticks
+    int numFaults;			// page faults so far
+    int numSuspensions;			// times it was suspended
+    int peakWorkingSet;			// largest working set we've seen
+    ResidentSet *next;			// the next process
+};
+
+// The following class defines the load controller.  There is one,
+// which knows about every process.
+
+class LoadControl {
+  public:
+    LoadControl(int nframes, int limit, int window);
+					// Initialize, for "nframes" frames 
+					// of memory, with at most "limit"
+					// resident pages per process, and
+					// a "window"-tick working set
+    ~LoadControl();
+
+    ResidentSet *Add(AddrSpace *space);	// A process is starting
+    void Remove(ResidentSet *process);	// ... or finishing; print its stats
+
+    void PageFault(ResidentSet *process);
+					// "process" faulted: adjust its 
+					// allocation, and suspend it if 
+					// memory is overcommitted
+    bool MayGrow(ResidentSet *process, int pages);
+					// Can "process" take "pages" more 
+					// frames, without giving up any 
+					// of its own?
+
+    void Print();			// Print each process's stats
+
+  private:
+    int available;			// frames processes can have
+    int limit;				// most resident pages per process
+    int window;				// working set window, in ticks
+    ResidentSet *processes;		// every process
+    int nextId;				// to number processes
+    List *suspended;			// processes waiting for memory,
+					// in order of suspension
+
+    int Demand();			// Total allocations of processes
+					// not suspended
+    int NumRunning();			// How many are not suspended?
+    void Suspend(ResidentSet *process);	// Swap "process" out, and wait
+					// for room for it
+    void ResumeWaiting();		// Resume suspended processes, as
+					// many as there's room for
+    int WorkingSet(ResidentSet *process);
+					// Pages "process" has used within 
+					// the window
+    void PrintProcess(ResidentSet *process);
+};
+
+#endif // LOADCTL_H
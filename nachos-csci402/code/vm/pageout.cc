@@ -0,0 +1,108 @@
+// pageout.cc 
+//	Routines for the pageout daemon, which writes pages to swap 
+//	ahead of their eviction.
+//
+//	The daemon only runs when another thread gives up the CPU: when
+//	it's preempted (with time-slicing, -rs), or blocks, or finishes.
+//	The frame allocator only wakes it up; a page fault never waits 
+//	for it, but evicts what it needs to itself -- just without the 
+//	write, if the daemon has got to the page first.  A page used 
+//	again after it was cleaned simply stays; if it's written again, 
+//	it's dirty again.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "pageout.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// PageoutThread
+// 	The procedure run by the daemon's thread.  "dummy" is not used.
+//----------------------------------------------------------------------
+
+static void
+PageoutThread(int dummy)
+{
+    pageoutDaemon->Run();
+}
+
+//----------------------------------------------------------------------
+// PageoutDaemon::PageoutDaemon
+// 	Set the low- and high-water marks, for "nframes" frames of 
+//	physical memory, and fork the daemon's thread.  It waits until 
+//	memory first runs low.
+//----------------------------------------------------------------------
+
+PageoutDaemon::PageoutDaemon(int nframes)
+{
+    Thread *t;
+
+    lowWater = max(nframes / 16, 1);
+    highWater = max(nframes / 8, lowWater + 1);
+    wanted = new Semaphore("pageout wanted", 0);
+    awake = FALSE;
+    t = new Thread("pageout");
+    t->Fork((VoidFunctionPtr)PageoutThread, 0);
+}
+
+//----------------------------------------------------------------------
+// PageoutDaemon::~PageoutDaemon
+// 	De-allocate the daemon's data structures.  Its thread never
+//	finishes; this is only done when Nachos halts.
+//----------------------------------------------------------------------
+
+PageoutDaemon::~PageoutDaemon()
+{
+    delete wanted;
+}
+
+//----------------------------------------------------------------------
+// PageoutDaemon::FramesLeft
+// 	Called by the frame allocator whenever it hands out a frame: if 
+//	"numFree" frames are below the low-water mark, wake up the daemon
+//	(if it isn't already).  It runs the next time this thread gives 
+//	up the CPU -- nothing here makes it.
+//----------------------------------------------------------------------
+
+void
+PageoutDaemon::FramesLeft(int numFree)
+{
+    if (awake || numFree >= lowWater)
+	return;
+    DEBUG('a', "Memory low (%d frames free), waking pageout daemon\n",
+	  numFree);
+    awake = TRUE;
+    wanted->V();
+}
+
+//----------------------------------------------------------------------
+// PageoutDaemon::MemoryShort
+// 	Return whether there are few frames free, so that frames taken
+//	now will soon have to come from other pages.
+//----------------------------------------------------------------------
+
+bool
+PageoutDaemon::MemoryShort()
+{
+    return frameAllocator->NumFree() < highWater;
+}
+
+//----------------------------------------------------------------------
+// PageoutDaemon::Run
+// 	Each time the daemon is woken up, clean the pages the policy 
+//	would evict next, up to the high-water mark, then go back to 
+//	sleep.  They stay in memory until a page fault needs their frames.
+//----------------------------------------------------------------------
+
+void
+PageoutDaemon::Run()
+{
+    for (;;) {
+	wanted->P();
+	pageReplacer->Clean(highWater);
+	awake = FALSE;
+    }
+}
@@ -0,0 +1,46 @@
+// pageout.h 
+//	Data structures for the pageout daemon: a kernel thread that
+//	cleans the pages next in line to be evicted, writing the dirty 
+//	ones to swap while they stay in memory, so that a page fault 
+//	that has to evict a page can usually take its frame right away,
+//	instead of waiting for it to be written first.
+//
+//	When the frame allocator sees the number of free frames drop below
+//	a low-water mark, the daemon is woken up, and cleans as many of
+//	the pages the replacement policy would evict next as the 
+//	high-water mark.  Since it cleans them all at once, they are 
+//	written to swap together, pages going to consecutive slots in a
+//	single transfer.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PAGEOUT_H
+#define PAGEOUT_H
+
+#include "copyright.h"
+#include "synch.h"
+
+// The following class defines the pageout daemon.
+
+class PageoutDaemon {
+  public:
+    PageoutDaemon(int nframes);		// Start up the daemon, for
+					// "nframes" frames of memory
+    ~PageoutDaemon();
+
+    void FramesLeft(int numFree);	// Wake up the daemon if "numFree"
+					// frames is too few
+    void Run();				// The daemon's thread: never returns
+
+    bool MemoryShort();			// Is memory short of free frames?
+
+  private:
+    int lowWater;			// wake up with fewer frames free
+    int highWater;			// how many pages to clean ahead
+    Semaphore *wanted;			// the daemon waits here for work
+    bool awake;				// has it been woken up?
+};
+
+#endif // PAGEOUT_H
@@ -0,0 +1,247 @@
+// replace.cc 
+//	Routines to choose pages to evict, and evict them.
+//
+//	The owner of a page in the inverted page table is either an
+//	address space (for a private page) or a program's image (for a
+//	shared page); only shared pages are read-only in the table, so
+//	that says which.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "replace.h"
+#include "system.h"
+#include "addrspace.h"
+#include "image.h"
+
+//----------------------------------------------------------------------
+// PageReplacer::PageReplacer
+// 	Initialize the page replacement policy.
+//
+//	"nframes" is the number of frames of physical memory
+//	"policy" is how to choose the page to evict
+//----------------------------------------------------------------------
+
+PageReplacer::PageReplacer(int nframes, ReplacementPolicy replacement)
+{
+    int i;
+
+    policy = replacement;
+    numFrames = nframes;
+    loadedAt = new int64_t[numFrames];
+    loadTicks = new int64_t[numFrames];
+    passedAt = new int64_t[numFrames];
+    for (i = 0; i < numFrames; i++)
+	loadedAt[i] = loadTicks[i] = passedAt[i] = 0;
+    numLoaded = 0;
+    hand = 0;
+}
+
+//----------------------------------------------------------------------
+// PageReplacer::~PageReplacer
+// 	De-allocate the policy's data structures.
+//----------------------------------------------------------------------
+
+PageReplacer::~PageReplacer()
+{
+    delete [] loadedAt;
+    delete [] loadTicks;
+    delete [] passedAt;
+}
+
+//----------------------------------------------------------------------
+// PageReplacer::GetFrame
+// 	Return a free frame, evicting pages until there is one.  Returns
+//	-1 if there's no free frame, and no page that can be evicted.
+//----------------------------------------------------------------------
+
+int
+PageReplacer::GetFrame()
+{
+    int frame, victim;
+
+    while ((frame = frameAllocator->Allocate()) == -1) {
+	if ((victim = Victim()) == -1)
+	    return -1;
+	Evict(victim);
+    }
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// PageReplacer::Clean
+// 	For the pageout daemon: write the dirty pages among the next 
+//	"count" the policy would evict to swap, as one batch, so that
+//	evicting them later needs no write.  They stay in memory (and 
+//	the policy's state is left alone).  Returns how many pages were
+//	written.
+//
+//	For CLOCK, the next pages are the ones the hand would reach 
+//	without their having been used since it last passed; the rest
+//	would get a second chance, so aren't worth writing yet.
+//----------------------------------------------------------------------
+
+int
+PageReplacer::Clean(int count)
+{
+    bool *chosen = new bool[numFrames];
+    int frame, next, found, i, written = 0;
+
+    if (policy != FifoReplacement)
+	machine->SampleUses();		// bring the use times up to date
+    swapSpace->BeginBatch();
+    if (policy == ClockReplacement) {
+	for (found = 0, i = 0; i < numFrames && found < count; i++) {
+	    frame = (hand + i) % numFrames;
+	    if (!ipt->Entry(frame)->valid
+		|| LastUsed(frame) > passedAt[frame])
+		continue;
+	    found++;
+	    if (CleanPage(frame))
+		written++;
+	}
+    } else {
+	for (frame = 0; frame < numFrames; frame++)
+	    chosen[frame] = FALSE;
+	for (found = 0; found < count; found++) {
+	    next = -1;
+	    for (frame = 0; frame < numFrames; frame++)
+		if (ipt->Entry(frame)->valid && !chosen[frame]
+		    && (next == -1 || Older(frame, next)))
+		    next = frame;
+	    if (next == -1)
+		break;			// every page has been looked at
+	    chosen[next] = TRUE;
+	    if (CleanPage(next))
+		written++;
+	}
+    }
+    swapSpace->EndBatch();
+    delete [] chosen;
+    return written;
+}
+
+//----------------------------------------------------------------------
+// PageReplacer::Loaded
+// 	Note that a page has just been put in "frame" (and entered in
+//	the inverted page table): it's the newest page in memory, and 
+//	the clock hand has, in effect, just passed it.
+//----------------------------------------------------------------------
+
+void
+PageReplacer::Loaded(int frame)
+{
+    loadedAt[frame] = ++numLoaded;
+    loadTicks[frame] = passedAt[frame] = stats->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// PageReplacer::LastUsed
+// 	Return when the page in "frame" was last used, as far as the
+//	machine can tell, or when it was loaded, if that was later: the 
+//	frame's use time may belong to the page that was in it before
+//	(and a page that was read ahead may not have been used yet).
+//----------------------------------------------------------------------
+
+int64_t
+PageReplacer::LastUsed(int frame)
+{
+    return max(machine->getTimeUsed(frame), loadTicks[frame]);
+}
+
+//----------------------------------------------------------------------
+// PageReplacer::Victim
+// 	Choose the page to evict, by the replacement policy, among the
+//	pages in the inverted page table.  Return its frame, or -1 if 
+//	there is no page to evict.
+//----------------------------------------------------------------------
+
+int
+PageReplacer::Victim()
+{
+    int frame, victim = -1, i;
+
+    if (policy != FifoReplacement)
+	machine->SampleUses();		// bring the use times up to date
+
+    switch (policy) {
+      case FifoReplacement:
+      case LruReplacement:
+	for (frame = 0; frame < numFrames; frame++)
+	    if (ipt->Entry(frame)->valid
+		&& (victim == -1 || Older(frame, victim)))
+		victim = frame;
+	break;
+      case ClockReplacement:
+	// give each page used since the hand passed it a second chance;
+	// after one sweep, every page has had its chance
+	for (i = 0; i < 2 * numFrames; i++) {
+	    frame = hand;
+	    hand = (hand + 1) % numFrames;
+	    if (!ipt->Entry(frame)->valid)
+		continue;
+	    if (LastUsed(frame) <= passedAt[frame]) {
+		victim = frame;
+		break;
+	    }
+	    passedAt[frame] = stats->totalTicks;
+	}
+	break;
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// PageReplacer::Older
+// 	Return whether FIFO or LRU (whichever is the policy) would evict
+//	the page in "frame" before the one in "other".
+//----------------------------------------------------------------------
+
+bool
+PageReplacer::Older(int frame, int other)
+{
+    if (policy == FifoReplacement)
+	return loadedAt[frame] < loadedAt[other];
+    return LastUsed(frame) < LastUsed(other)
+	|| (LastUsed(frame) == LastUsed(other)
+	    && loadedAt[frame] < loadedAt[other]);
+}
+
+//----------------------------------------------------------------------
+// PageReplacer::CleanPage
+// 	Ask the owner of the page in "frame" to write it to swap, if 
+//	it's dirty; it stays in memory.  Shared pages are never written,
+//	so are always clean.  Return whether it was written.
+//----------------------------------------------------------------------
+
+bool
+PageReplacer::CleanPage(int frame)
+{
+    TranslationEntry *entry = ipt->Entry(frame);
+
+    if (entry->readOnly)
+	return FALSE;
+    return ((AddrSpace *) ipt->Owner(frame))->Clean(entry->virtualPage);
+}
+
+//----------------------------------------------------------------------
+// PageReplacer::Evict
+// 	Evict the page in "frame", by asking its owner to give it up;
+//	afterwards the frame is free.
+//----------------------------------------------------------------------
+
+void
+PageReplacer::Evict(int frame)
+{
+    TranslationEntry *entry = ipt->Entry(frame);
+
+    DEBUG('a', "Evicting page %d from frame %d\n", entry->virtualPage, 
+	  frame);
+    stats->numEvictions++;
+    if (entry->readOnly)
+	((ProgramImage *) ipt->Owner(frame))->Evict(entry->virtualPage);
+    else
+	((AddrSpace *) ipt->Owner(frame))->Evict(entry->virtualPage);
+}
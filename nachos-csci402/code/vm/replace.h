@@ -0,0 +1,72 @@
+// replace.h 
+//	Data structures for page replacement: choosing which page to 
+//	evict from physical memory when a page fault finds no free frame.
+//
+//	The policies are:
+//
+//	  FIFO -- evict the page that has been in memory longest
+//	  CLOCK -- sweep a hand around the frames, evicting the first
+//		page that hasn't been used since the hand last passed it
+//		("second chance")
+//	  LRU -- evict the page used least recently, as far as the 
+//		machine's use bits tell (see Machine::getTimeUsed)
+//
+//	The use bits are sampled (Machine::SampleUses) by the page aging
+//	clock, and again whenever we choose a page to evict.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef REPLACE_H
+#define REPLACE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// How PageReplacer::Victim chooses the page to evict
+
+enum ReplacementPolicy { FifoReplacement, ClockReplacement, 
+			 LruReplacement };
+
+// The following class defines the page replacement policy.  It can
+// evict any page in the inverted page table.
+
+class PageReplacer {
+  public:
+    PageReplacer(int nframes, ReplacementPolicy policy);
+    ~PageReplacer();
+
+    int GetFrame();			// Return a free frame, now in use,
+					// evicting a page to make one if
+					// need be; -1 if none can be
+    void Loaded(int frame);		// Note that a page has just been
+					// put in "frame"
+    int Clean(int count);		// Write the dirty ones of the next
+					// "count" pages to be evicted to 
+					// swap, batched; return how many 
+					// were written
+    int64_t LastUsed(int frame);	// When the page in "frame" was last
+					// used (or loaded)
+
+  private:
+    int Victim();			// Choose the page to evict; return
+					// its frame, or -1 if there is none
+    bool Older(int frame, int other);	// Would FIFO or LRU evict the page
+					// in "frame" before "other"'s?
+    bool CleanPage(int frame);		// Clean the page in "frame"
+    void Evict(int frame);		// Evict the page in "frame"
+
+    ReplacementPolicy policy;
+    int numFrames;
+    int64_t *loadedAt;			// for each frame, when its page
+					// was put in it, in order of loading
+    int64_t numLoaded;			// how many pages have been loaded
+    int64_t *loadTicks;			// for each frame, when its page was
+					// put in it, in ticks
+    int64_t *passedAt;			// for each frame, when the clock 
+					// hand last passed it, in ticks
+    int hand;				// where the clock hand is
+};
+
+#endif // REPLACE_H
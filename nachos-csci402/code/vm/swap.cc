@@ -0,0 +1,176 @@
+// swap.cc 
+//	Routines to manage the swap file.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "swap.h"
+#include "system.h"
+#include "string.h"
+
+//----------------------------------------------------------------------
+// SwapSpace::SwapSpace
+// 	Create the swap file, with every slot free.  A swap file left
+//	behind by a run that didn't clean up is replaced.
+//
+//	"fileName" is the name of the swap file
+//	"nslots" is the number of page-sized slots in it
+//----------------------------------------------------------------------
+
+SwapSpace::SwapSpace(char *fileName, int nslots)
+{
+    name = new char[strlen(fileName) + 1];
+    strcpy(name, fileName);
+    fileSystem->Remove(name);		// in case it's left over
+    if (!fileSystem->Create(name, nslots * PageSize)
+	|| (file = fileSystem->Open(name)) == NULL) {
+	printf("Unable to create swap file %s\n", name);
+	Exit(1);
+    }
+    slots = new BitMap(nslots);
+    batching = FALSE;
+    numPending = 0;
+    pendingSlots = new int[SwapBatchPages];
+    pendingData = new char[SwapBatchPages * PageSize];
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::~SwapSpace
+// 	Close the swap file, and remove it.
+//----------------------------------------------------------------------
+
+SwapSpace::~SwapSpace()
+{
+    delete slots;
+    delete [] pendingSlots;
+    delete [] pendingData;
+    delete file;
+    fileSystem->Remove(name);
+    delete [] name;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Allocate
+// 	Return a free slot, now in use, or -1 if the swap file is full.
+//----------------------------------------------------------------------
+
+int
+SwapSpace::Allocate()
+{
+    return slots->Find();
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Free
+// 	Put "slot" back in the free pool.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Free(int slot)
+{
+    ASSERT(slots->Test(slot));
+    slots->Clear(slot);
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Write
+// 	Write the contents of physical page "frame" to "slot" -- or, in
+//	a batch, copy them aside to write later, so the frame can be 
+//	reused right away.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Write(int slot, int frame)
+{
+    if (batching) {
+	if (numPending == SwapBatchPages)
+	    WriteBatch();
+	pendingSlots[numPending] = slot;
+	memcpy(&pendingData[numPending * PageSize],
+	       &machine->mainMemory[frame * PageSize], PageSize);
+	numPending++;
+	return;
+    }
+    DEBUG('a', "Writing frame %d to swap slot %d\n", frame, slot);
+    file->WriteAt(&machine->mainMemory[frame * PageSize], PageSize,
+		  slot * PageSize);
+    stats->numSwapWrites++;
+    stats->numSwapTransfers++;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Read
+// 	Read "slot" into physical page "frame".
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Read(int slot, int frame)
+{
+    ASSERT(numPending == 0);		// it might be one of them
+    DEBUG('a', "Reading swap slot %d into frame %d\n", slot, frame);
+    file->ReadAt(&machine->mainMemory[frame * PageSize], PageSize,
+		 slot * PageSize);
+    stats->numSwapReads++;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::BeginBatch
+// 	Start saving up writes, to do together.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::BeginBatch()
+{
+    batching = TRUE;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::EndBatch
+// 	Do the writes saved up since BeginBatch, and go back to writing
+//	pages as we're asked to.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::EndBatch()
+{
+    WriteBatch();
+    batching = FALSE;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::WriteBatch
+// 	Write the pages saved up, in order of slot, so that each run of
+//	pages going to consecutive slots takes one transfer.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::WriteBatch()
+{
+    char *run = new char[numPending * PageSize];
+    int order[SwapBatchPages];
+    int i, j, first, count, t;
+
+    for (i = 0; i < numPending; i++) {		// insertion sort, by slot
+	for (j = i; j > 0 && pendingSlots[order[j - 1]] > pendingSlots[i]; j--)
+	    order[j] = order[j - 1];
+	order[j] = i;
+    }
+    for (i = 0; i < numPending; i += count) {
+	first = pendingSlots[order[i]];
+	for (count = 0; i + count < numPending
+			&& pendingSlots[order[i + count]] == first + count;
+	     count++) {
+	    t = order[i + count];
+	    memcpy(&run[count * PageSize], &pendingData[t * PageSize],
+		   PageSize);
+	}
+	DEBUG('a', "Writing swap slots %d to %d\n", first, first + count - 1);
+	file->WriteAt(run, count * PageSize, first * PageSize);
+	stats->numSwapWrites += count;
+	stats->numSwapTransfers++;
+    }
+    numPending = 0;
+    delete [] run;
+}
@@ -0,0 +1,68 @@
+// swap.h 
+//	Data structures for the backing store of virtual memory: a file
+//	where pages that have been evicted from physical memory are kept
+//	until they are needed again.
+//
+//	The file is divided into page-sized slots; a bitmap says which
+//	are in use.  Pages of a program's code and initialized data that
+//	haven't been written never go to swap, since they can be read 
+//	from the executable again, and neither do pages of zeros.
+//
+//	Writes can be batched: between BeginBatch and EndBatch, pages
+//	written are only copied aside, and at the end, pages going to
+//	consecutive slots are written with one transfer each.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SWAP_H
+#define SWAP_H
+
+#include "copyright.h"
+#include "bitmap.h"
+#include "filesys.h"
+
+#ifdef FILESYS
+#include "filehdr.h"
+
+// With the Nachos file system, the swap file is a Nachos file, so it
+// can be no bigger than a file header can map.
+#define SwapPages	((int) (MaxFileSize / PageSize))
+#else
+#define SwapPages	4096		// number of slots in the swap file
+#endif
+#define SwapBatchPages	32		// most pages written in one batch
+
+// The following class defines the swap file.
+
+class SwapSpace {
+  public:
+    SwapSpace(char *fileName, int nslots); // Create a swap file, with 
+					// "nslots" slots, all of them free
+    ~SwapSpace();			// Close the swap file, and remove it
+
+    int Allocate();			// Return a free slot, now in use; 
+					// -1 if there is none
+    void Free(int slot);		// Return "slot" to the free pool
+
+    void Write(int slot, int frame);	// Write physical page "frame" to
+					// "slot"
+    void Read(int slot, int frame);	// Read "slot" into physical page
+					// "frame"
+
+    void BeginBatch();			// Start saving up writes
+    void EndBatch();			// Do the writes saved up
+
+  private:
+    char *name;				// the swap file's name
+    OpenFile *file;			// the swap file
+    BitMap *slots;			// which slots are in use
+    bool batching;			// are we saving up writes?
+    int numPending;			// how many are saved up
+    int *pendingSlots;			// where each one goes
+    char *pendingData;			// what each one writes
+    void WriteBatch();			// Write the pages saved up
+};
+
+#endif // SWAP_H